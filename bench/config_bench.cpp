@@ -0,0 +1,140 @@
+/* config_bench: Config lookup benchmark for the message handlers
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "settings.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+/**
+ * A message, with what the handlers check about it
+ */
+struct message {
+    dpp::snowflake author; /**< ID of the author */
+    dpp::snowflake channel; /**< ID of the channel it was sent in */
+    bool author_is_owner; /**< Whether the author has the owner role */
+};
+
+/**
+ * Do the config lookups messages.cpp used to do for a message being sent, edited and deleted
+ * @param config JSON bot config data
+ * @param msg Message to handle
+ * @return Sum of the IDs looked up, so the lookups can't be optimized out
+ */
+static uint64_t handle_json(const nlohmann::json& config, const message& msg) {
+    uint64_t sum = 0;
+    // on_message
+    if (msg.author == config["disboard_bot_id"].get<dpp::snowflake>()) {
+        sum += 1;
+    } else {
+        bool msg_in_public_nonsupport_channel = false;
+        for (const auto& channel : config["public_channel_ids"]) {
+            if (msg.channel == channel.get<dpp::snowflake>()) {
+                msg_in_public_nonsupport_channel = true;
+                break;
+            }
+        }
+        if (msg_in_public_nonsupport_channel) {
+            sum += config["support_channel_ids"]["general_support"].get<uint64_t>() + config["role_ids"]["support_team"].get<uint64_t>();
+        }
+    }
+    // on_message_edited and on_message_deleted
+    for (const char* log : {"message_edited", "message_deleted"}) {
+        sum += config["guild_id"].get<dpp::snowflake>();
+        if (msg.author_is_owner) {
+            sum += config["role_ids"]["owner"].get<dpp::snowflake>();
+            continue;
+        }
+        sum += config["log_channel_ids"][log].get<dpp::snowflake>();
+    }
+    return sum;
+}
+
+/**
+ * Do the same lookups with the typed config
+ * @param config Typed bot config data
+ * @param msg Message to handle
+ * @return Sum of the IDs looked up, which matches handle_json
+ */
+static uint64_t handle_typed(const settings::typed_config& config, const message& msg) {
+    uint64_t sum = 0;
+    if (msg.author == config.disboard_bot_id) {
+        sum += 1;
+    } else if (config.is_public_channel(msg.channel)) {
+        sum += config.support_channel_ids.general_support + config.role_ids.support_team;
+    }
+    for (const dpp::snowflake log : {config.log_channel_ids.message_edited, config.log_channel_ids.message_deleted}) {
+        sum += config.guild_id;
+        if (msg.author_is_owner) {
+            sum += config.role_ids.owner;
+            continue;
+        }
+        sum += log;
+    }
+    return sum;
+}
+
+/**
+ * Time handling every message in a list many times
+ * @param handle Function that handles a message
+ * @param messages Messages to handle
+ * @param rounds Number of times to go through the list
+ * @param checksum Incremented by the result of every call, so the calls can't be optimized out
+ * @return Average time per message in nanoseconds
+ */
+template <typename Handle>
+static double time_handling(const Handle& handle, const std::vector<message>& messages, const size_t rounds, uint64_t& checksum) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (const message& msg : messages) {
+            checksum += handle(msg);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * messages.size());
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: " << argv[0] << " <data directory> [rounds]" << std::endl;
+        return 2;
+    }
+    const size_t rounds = argc > 2 ? std::stoull(argv[2]) : 100000;
+    std::string error;
+    if (!settings::load(argv[1], error)) {
+        std::cerr << error << std::endl;
+        return 2;
+    }
+    const settings::snapshot json = settings::config();
+    const std::shared_ptr<const settings::typed_config> typed = settings::typed();
+
+    // Messages in each public channel and in a support channel, from regular members, an owner and DISBOARD
+    std::vector<message> messages;
+    std::vector<dpp::snowflake> channels = typed->public_channel_ids;
+    channels.push_back(typed->support_channel_ids.general_support);
+    for (const dpp::snowflake channel : channels) {
+        messages.push_back({854429524304723001ULL, channel, false});
+        messages.push_back({854429524304723002ULL, channel, true});
+        messages.push_back({typed->disboard_bot_id, channel, false});
+    }
+
+    uint64_t json_checksum = 0;
+    uint64_t typed_checksum = 0;
+    const double json_ns = time_handling([&json](const message& msg) { return handle_json(*json, msg); }, messages, rounds, json_checksum);
+    const double typed_ns = time_handling([&typed](const message& msg) { return handle_typed(*typed, msg); }, messages, rounds, typed_checksum);
+
+    std::cout << "Config lookups per message (sent, edited and deleted): "
+              << json_ns << " ns with JSON, " << typed_ns << " ns with typed config" << std::endl;
+    return json_checksum == typed_checksum ? 0 : 1;
+}
@@ -0,0 +1,99 @@
+/* dispatch_bench: Slash command dispatch benchmark
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "command_table.h"
+#include "builtin_command_names.h"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using commands::BUILTIN_COMMAND_NAMES;
+
+/**
+ * Pair each built-in command name with its index
+ * @return Names and indexes, in the same order as BUILTIN_COMMAND_NAMES
+ */
+static consteval std::array<std::pair<std::string_view, int>, BUILTIN_COMMAND_NAMES.size()> indexed_names() {
+    std::array<std::pair<std::string_view, int>, BUILTIN_COMMAND_NAMES.size()> entries;
+    for (size_t i = 0; i < entries.size(); i++) {
+        entries[i] = {BUILTIN_COMMAND_NAMES[i], static_cast<int>(i)};
+    }
+    return entries;
+}
+
+/**
+ * The built-in commands from main.cpp, mapped to their index
+ */
+static constexpr commands::command_table BUILTIN_COMMANDS(indexed_names());
+
+/**
+ * Dispatch the way main.cpp used to, comparing against every name in turn
+ * @param name Command name
+ * @return Index of the command, or -1 if it isn't built in
+ */
+static int dispatch_chain(const std::string& name) {
+    for (size_t i = 0; i < BUILTIN_COMMAND_NAMES.size(); i++) {
+        if (name == BUILTIN_COMMAND_NAMES[i]) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Dispatch with the command table
+ * @param name Command name
+ * @return Index of the command, or -1 if it isn't built in
+ */
+static int dispatch_table(const std::string& name) {
+    const int* index = BUILTIN_COMMANDS.find(name);
+    return index == nullptr ? -1 : *index;
+}
+
+/**
+ * Time dispatching every name in a list many times
+ * @param dispatch Dispatch function to time
+ * @param names Names to dispatch
+ * @param rounds Number of times to go through the list
+ * @param checksum Incremented by the result of every dispatch, so the calls can't be optimized out
+ * @return Average time per dispatch in nanoseconds
+ */
+static double time_dispatch(int (*dispatch)(const std::string&), const std::vector<std::string>& names, const size_t rounds, long long& checksum) {
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        for (const std::string& name : names) {
+            checksum += dispatch(name);
+        }
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (rounds * names.size());
+}
+
+int main(int argc, char* argv[]) {
+    const size_t rounds = argc > 1 ? std::stoull(argv[1]) : 100000;
+    const std::vector<std::string> builtin_names(BUILTIN_COMMAND_NAMES.begin(), BUILTIN_COMMAND_NAMES.end());
+    // Names of the kind that DB commands have, which fall through every built-in comparison
+    const std::vector<std::string> db_names = {"ask", "dontasktoask", "nohello", "google", "logs", "specs", "windows-iso", "safe-mode"};
+
+    long long chain_checksum = 0;
+    long long table_checksum = 0;
+    const double chain_builtin = time_dispatch(dispatch_chain, builtin_names, rounds, chain_checksum);
+    const double table_builtin = time_dispatch(dispatch_table, builtin_names, rounds, table_checksum);
+    const double chain_db = time_dispatch(dispatch_chain, db_names, rounds, chain_checksum);
+    const double table_db = time_dispatch(dispatch_table, db_names, rounds, table_checksum);
+
+    std::cout << "Built-in commands: " << chain_builtin << " ns with if/else, " << table_builtin << " ns with table\n"
+              << "DB commands:       " << chain_db << " ns with if/else, " << table_db << " ns with table" << std::endl;
+    return chain_checksum == table_checksum ? 0 : 1;
+}
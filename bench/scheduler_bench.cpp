@@ -0,0 +1,84 @@
+/* scheduler_bench: Timing wheel benchmark
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scheduler.h"
+#include <chrono>
+#include <iostream>
+#include <random>
+
+/**
+ * Time a function
+ * @param function Function to run
+ * @return Time taken in milliseconds
+ */
+static double time_ms(const std::function<void()>& function) {
+    const auto start = std::chrono::steady_clock::now();
+    function();
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    const uint64_t timer_count = argc > 1 ? std::stoull(argv[1]) : 100000;
+    // Deadlines spread over 30 days of one-second ticks, like a backlog of reminders and mutes
+    constexpr uint64_t HORIZON = 30 * 86400;
+
+    scheduler::timing_wheel wheel;
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<uint64_t> deadline_dist(1, HORIZON);
+    std::vector<uint64_t> deadlines(timer_count);
+    for (uint64_t& deadline : deadlines) {
+        deadline = deadline_dist(rng);
+    }
+
+    uint64_t fired = 0;
+    uint64_t late = 0;
+    uint64_t tick = 0;
+    std::vector<uint64_t> ids;
+    ids.reserve(timer_count);
+    const double schedule_ms = time_ms([&] {
+        for (const uint64_t deadline : deadlines) {
+            ids.push_back(wheel.schedule(deadline, [&fired, &late, &tick, deadline] {
+                fired++;
+                late += tick != deadline;
+            }));
+        }
+    });
+    // Cancel every tenth timer, as if the reminder was deleted or the user was unmuted early
+    uint64_t cancelled = 0;
+    const double cancel_ms = time_ms([&] {
+        for (size_t i = 0; i < ids.size(); i += 10) {
+            cancelled += wheel.cancel(ids[i]);
+        }
+    });
+
+    // Run every tick until the last deadline, firing callbacks as the scheduler thread does
+    std::vector<std::function<void()>> due;
+    const double advance_ms = time_ms([&] {
+        for (; tick <= HORIZON; tick++) {
+            wheel.advance(tick, due);
+            for (std::function<void()>& callback : due) {
+                callback();
+            }
+            due.clear();
+        }
+    });
+
+    std::cout << "Timers:           " << timer_count << '\n'
+              << "Schedule:         " << schedule_ms << " ms (" << schedule_ms * 1e6 / timer_count << " ns each)\n"
+              << "Cancel:           " << cancel_ms << " ms for " << cancelled << " timers\n"
+              << "Advance " << HORIZON << " ticks: " << advance_ms << " ms (" << advance_ms * 1e6 / HORIZON << " ns per tick)\n"
+              << "Fired:            " << fired << " (" << late << " off their deadline)\n"
+              << "Still pending:    " << wheel.size() << std::endl;
+    return fired + cancelled == timer_count && late == 0 && wheel.size() == 0 ? 0 : 1;
+}
@@ -40,14 +40,18 @@ CREATE TABLE reminders(
     start_time INTEGER,
     end_time INTEGER,
     user TEXT,
-    text TEXT
+    text TEXT,
+    guild TEXT
 ) STRICT;
+CREATE INDEX reminders_end_time ON reminders(end_time);
 
 CREATE TABLE mutes(
     id INTEGER PRIMARY KEY ASC,
     start_time INTEGER,
-    end_time INTEGER
+    end_time INTEGER,
+    guild TEXT
 );
+CREATE INDEX mutes_end_time ON mutes(end_time);
 
 CREATE TABLE mod_records(
     id TEXT PRIMARY KEY,
@@ -56,7 +60,27 @@ CREATE TABLE mod_records(
     user TEXT,
     reason TEXT,
     active TEXT,
-    extra_data INTEGER
+    extra_data INTEGER,
+    guild TEXT
+) WITHOUT ROWID;
+CREATE INDEX mod_records_user ON mod_records(user, id);
+CREATE INDEX mod_records_active_mutes ON mod_records(extra_data) WHERE type = 'Mute' AND active = 'true';
+CREATE INDEX mod_records_active_warnings ON mod_records(id) WHERE type = 'Warning' AND active = 'true';
+
+CREATE TABLE bot_state(
+    guild TEXT,
+    key TEXT,
+    value INTEGER,
+    PRIMARY KEY (guild, key)
+) WITHOUT ROWID;
+
+CREATE TABLE mod_stats(
+    day INTEGER,
+    guild TEXT,
+    moderator TEXT,
+    type TEXT,
+    count INTEGER,
+    PRIMARY KEY (day, guild, moderator, type)
 ) WITHOUT ROWID;
 CREATE TABLE staff_applications(
     id TEXT,
@@ -82,5 +106,50 @@ CREATE TABLE ban_appeals(
     reason TEXT,
     appeal TEXT
 );
+
+CREATE VIRTUAL TABLE mod_records_fts USING fts5(reason, tokenize='porter unicode61');
+CREATE TRIGGER mod_records_fts_insert AFTER INSERT ON mod_records BEGIN
+    INSERT INTO mod_records_fts(rowid, reason) VALUES (CAST(new.id AS INTEGER), new.reason);
+END;
+CREATE TRIGGER mod_records_fts_delete AFTER DELETE ON mod_records BEGIN
+    DELETE FROM mod_records_fts WHERE rowid = CAST(old.id AS INTEGER);
+END;
+CREATE TRIGGER mod_records_fts_update AFTER UPDATE OF id, reason ON mod_records BEGIN
+    DELETE FROM mod_records_fts WHERE rowid = CAST(old.id AS INTEGER);
+    INSERT INTO mod_records_fts(rowid, reason) VALUES (CAST(new.id AS INTEGER), new.reason);
+END;
+
+CREATE VIRTUAL TABLE ban_appeals_fts USING fts5(reason, appeal, content='ban_appeals', tokenize='porter unicode61');
+CREATE TRIGGER ban_appeals_fts_insert AFTER INSERT ON ban_appeals BEGIN
+    INSERT INTO ban_appeals_fts(rowid, reason, appeal) VALUES (new.rowid, new.reason, new.appeal);
+END;
+CREATE TRIGGER ban_appeals_fts_delete AFTER DELETE ON ban_appeals BEGIN
+    INSERT INTO ban_appeals_fts(ban_appeals_fts, rowid, reason, appeal) VALUES ('delete', old.rowid, old.reason, old.appeal);
+END;
+CREATE TRIGGER ban_appeals_fts_update AFTER UPDATE OF reason, appeal ON ban_appeals BEGIN
+    INSERT INTO ban_appeals_fts(ban_appeals_fts, rowid, reason, appeal) VALUES ('delete', old.rowid, old.reason, old.appeal);
+    INSERT INTO ban_appeals_fts(rowid, reason, appeal) VALUES (new.rowid, new.reason, new.appeal);
+END;
+
+CREATE VIRTUAL TABLE staff_applications_fts USING fts5(q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, content='staff_applications', tokenize='porter unicode61');
+CREATE TRIGGER staff_applications_fts_insert AFTER INSERT ON staff_applications BEGIN
+    INSERT INTO staff_applications_fts(rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10)
+    VALUES (new.rowid, new.q1, new.q2, new.q3, new.q4, new.q5, new.q6, new.q7, new.q8, new.q9, new.q10);
+END;
+CREATE TRIGGER staff_applications_fts_delete AFTER DELETE ON staff_applications BEGIN
+    INSERT INTO staff_applications_fts(staff_applications_fts, rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10)
+    VALUES ('delete', old.rowid, old.q1, old.q2, old.q3, old.q4, old.q5, old.q6, old.q7, old.q8, old.q9, old.q10);
+END;
+CREATE TRIGGER staff_applications_fts_update AFTER UPDATE OF q1, q2, q3, q4, q5, q6, q7, q8, q9, q10 ON staff_applications BEGIN
+    INSERT INTO staff_applications_fts(staff_applications_fts, rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10)
+    VALUES ('delete', old.rowid, old.q1, old.q2, old.q3, old.q4, old.q5, old.q6, old.q7, old.q8, old.q9, old.q10);
+    INSERT INTO staff_applications_fts(rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10)
+    VALUES (new.rowid, new.q1, new.q2, new.q3, new.q4, new.q5, new.q6, new.q7, new.q8, new.q9, new.q10);
+END;
 "
-# mod_records extra_data is currently either the number of seconds to delete messages for in a ban, or a mutes table row ID.
\ No newline at end of file
+# The guild columns hold the ID of the server a row is from. bot_state rows that aren't for any server, like the global command hashes, use guild 0.
+# Ban appeals, staff applications and DB commands are only for the main server, so they have no guild column.
+# mod_records extra_data is currently either the number of seconds to delete messages for in a ban, or a mutes table row ID.
+# The *_fts tables are full-text indexes kept in sync by the triggers above. mod_records_fts rows use the record ID as their rowid.
+# ban_appeals_fts and staff_applications_fts read their text from the rowid of the original tables, so after a VACUUM renumbers those rowids they must be rebuilt with
+# INSERT INTO ban_appeals_fts(ban_appeals_fts) VALUES ('rebuild'); and the same for staff_applications_fts.
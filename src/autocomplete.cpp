@@ -0,0 +1,153 @@
+/* autocomplete: Slash command autocomplete from in-memory prefix indexes
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "autocomplete.h"
+#include "db.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "util.h"
+#include <array>
+#include <optional>
+#include <ranges>
+#include <shared_mutex>
+
+static std::shared_mutex index_mutex; /**< Guards indexes */
+static std::array<autocomplete::prefix_trie, autocomplete::INDEX_COUNT> indexes; /**< Values to suggest, by index */
+/**
+ * Values added (true) or removed (false) while an index is being reloaded, in order, so they can be applied
+ * to the reloaded index. Guarded by index_mutex, and only present while that index is being reloaded.
+ */
+static std::array<std::optional<std::vector<std::pair<bool, std::string>>>, autocomplete::INDEX_COUNT> pending_changes;
+
+/**
+ * Queries that load the indexes that come from the DB
+ */
+static const std::array<std::pair<autocomplete::index, const char*>, 3> DB_INDEX_QUERIES = {{
+    {autocomplete::WARNINGS, "SELECT guild || ':' || id FROM mod_records WHERE type = 'Warning' AND active = 'true';"},
+    {autocomplete::APPEALS, "SELECT DISTINCT id FROM ban_appeals WHERE status = 'pending';"},
+    {autocomplete::APPLICATIONS, "SELECT DISTINCT id FROM staff_applications WHERE status = 'pending';"}
+}};
+
+/**
+ * Commands whose options are autocompleted, and the index each one suggests from
+ */
+static const std::unordered_map<std::string, autocomplete::index> COMMAND_INDEXES = {
+    {"remove-db-command", autocomplete::DB_COMMANDS},
+    {"add-embed-command-field", autocomplete::EMBED_COMMANDS},
+    {"remove-embed-command-field", autocomplete::EMBED_COMMANDS},
+    {"edit-embed-command-field", autocomplete::EMBED_COMMANDS},
+    {"unwarn", autocomplete::WARNINGS},
+    {"appeal-respond", autocomplete::APPEALS},
+    {"application-respond", autocomplete::APPLICATIONS}
+};
+
+/**
+ * Rebuild the indexes that come from the DB, then schedule doing it again after the interval in the current config
+ * @param db SQLite DB pointer to load from
+ */
+static void reload_db_indexes(sqlite3* db) {
+    for (const auto& [index, sql] : DB_INDEX_QUERIES) {
+        {
+            std::lock_guard lock(index_mutex);
+            pending_changes[index].emplace();
+        }
+        std::vector<std::tuple<std::string>> rows;
+        if (!db::query(db, sql, rows)) {
+            util::log("ERROR", "Failed to load autocomplete values from DB");
+            std::lock_guard lock(index_mutex);
+            pending_changes[index].reset();
+            continue;
+        }
+        // Built without the lock so autocomplete isn't held up, then swapped in
+        autocomplete::prefix_trie trie;
+        for (const auto& [value] : rows) {
+            trie.insert(value);
+        }
+        std::lock_guard lock(index_mutex);
+        // Changes made since the query started may not be in its results, so they're applied again
+        for (const auto& [added, value] : *pending_changes[index]) {
+            if (added) {
+                trie.insert(value);
+            } else {
+                trie.erase(value);
+            }
+        }
+        pending_changes[index].reset();
+        indexes[index] = std::move(trie);
+    }
+    const time_t interval = (*settings::config())["autocomplete_refresh_seconds"].get<time_t>();
+    scheduler::schedule(time(nullptr) + interval, [db] {
+        reload_db_indexes(db);
+    });
+}
+
+void autocomplete::start(sqlite3* db, const std::unordered_map<std::string, db_commands::text_command>& text_commands,
+                         const std::unordered_map<std::string, db_commands::embed_command>& embed_commands) {
+    {
+        std::lock_guard lock(index_mutex);
+        for (const std::string& name : text_commands | std::views::keys) {
+            indexes[DB_COMMANDS].insert(name);
+        }
+        for (const std::string& name : embed_commands | std::views::keys) {
+            indexes[DB_COMMANDS].insert(name);
+            indexes[EMBED_COMMANDS].insert(name);
+        }
+    }
+    reload_db_indexes(db);
+}
+
+void autocomplete::add(const index index, const std::string_view value) {
+    std::lock_guard lock(index_mutex);
+    indexes[index].insert(value);
+    if (pending_changes[index]) {
+        pending_changes[index]->emplace_back(true, value);
+    }
+}
+
+void autocomplete::remove(const index index, const std::string_view value) {
+    std::lock_guard lock(index_mutex);
+    indexes[index].erase(value);
+    if (pending_changes[index]) {
+        pending_changes[index]->emplace_back(false, value);
+    }
+}
+
+void autocomplete::on_autocomplete(const dpp::autocomplete_t& event) {
+    auto command_index = COMMAND_INDEXES.find(event.name);
+    if (command_index == COMMAND_INDEXES.end()) {
+        return;
+    }
+    // Every autocompleted option is a string, and only the one being typed is focused
+    auto option = std::ranges::find_if(event.options, [](const dpp::command_option& o) {
+        return o.focused && std::holds_alternative<std::string>(o.value);
+    });
+    if (option == event.options.end()) {
+        return;
+    }
+
+    // Warnings are only suggested in the server they're from
+    const std::string prefix = command_index->second == WARNINGS ? event.command.guild_id.str() + ':' : "";
+    std::vector<std::string> values;
+    {
+        std::shared_lock lock(index_mutex);
+        // Discord shows at most 25 suggestions
+        values = indexes[command_index->second].find(prefix + std::get<std::string>(option->value), 25);
+    }
+    dpp::interaction_response response(dpp::ir_autocomplete_reply);
+    for (const std::string& value : values) {
+        const std::string suggestion = value.substr(prefix.size());
+        response.add_autocomplete_choice(dpp::command_option_choice(suggestion, suggestion));
+    }
+    event.owner->interaction_response_create(event.command.id, event.command.token, response);
+}
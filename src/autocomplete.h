@@ -0,0 +1,191 @@
+/* autocomplete: Slash command autocomplete from in-memory prefix indexes
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "command_modules/db_commands.h"
+#include <dpp/dpp.h>
+#include <sqlite3.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace autocomplete {
+    /**
+     * Set of strings that can be listed by prefix in sorted order.
+     * Finding a prefix takes one step per character no matter how many strings there are, and listing stops
+     * after the limit, so lookups stay fast as the set grows. Not thread-safe on its own.
+     */
+    class prefix_trie {
+        static constexpr uint32_t NONE = UINT32_MAX; /**< Node index meaning there's no such node */
+
+        /**
+         * One character of one or more strings
+         */
+        struct node {
+            std::vector<std::pair<char, uint32_t>> children; /**< Index of the next node by character, sorted by character */
+            bool terminal = false; /**< Whether a string ends here */
+        };
+
+        std::vector<node> nodes = std::vector<node>(1); /**< All nodes, with the root first */
+        size_t count = 0; /**< Number of strings in the set */
+
+        /**
+         * Find the node a string ends at
+         * @param str String to look for
+         * @return Index of the node, or NONE if no string in the set starts with str
+         */
+        [[nodiscard]] uint32_t find_node(const std::string_view str) const {
+            uint32_t index = 0;
+            for (const char c : str) {
+                const auto& children = nodes[index].children;
+                auto child = std::ranges::lower_bound(children, c, {}, &std::pair<char, uint32_t>::first);
+                if (child == children.end() || child->first != c) {
+                    return NONE;
+                }
+                index = child->second;
+            }
+            return index;
+        }
+
+        /**
+         * Add the strings under a node to a list, in sorted order
+         * @param index Index of the node
+         * @param str String leading to the node, which is restored before returning
+         * @param limit Maximum length of the list
+         * @param results List to add to
+         */
+        void collect(const uint32_t index, std::string& str, const size_t limit, std::vector<std::string>& results) const {
+            if (nodes[index].terminal) {
+                results.push_back(str);
+            }
+            for (const auto& [c, child] : nodes[index].children) {
+                if (results.size() >= limit) {
+                    return;
+                }
+                str.push_back(c);
+                collect(child, str, limit, results);
+                str.pop_back();
+            }
+        }
+
+        public:
+            /**
+             * Add a string to the set
+             * @param str String to add
+             */
+            void insert(const std::string_view str) {
+                uint32_t index = 0;
+                for (const char c : str) {
+                    auto& children = nodes[index].children;
+                    auto child = std::ranges::lower_bound(children, c, {}, &std::pair<char, uint32_t>::first);
+                    if (child == children.end() || child->first != c) {
+                        child = children.emplace(child, c, static_cast<uint32_t>(nodes.size()));
+                        index = child->second;
+                        // Invalidates children, so it's done last
+                        nodes.emplace_back();
+                    } else {
+                        index = child->second;
+                    }
+                }
+                if (!nodes[index].terminal) {
+                    nodes[index].terminal = true;
+                    count++;
+                }
+            }
+
+            /**
+             * Remove a string from the set. Its nodes are kept for a later insert to reuse; the indexes that come from
+             * the DB are rebuilt regularly, and the command name indexes change too rarely for them to add up.
+             * @param str String to remove
+             * @return true if the string was in the set
+             */
+            bool erase(const std::string_view str) {
+                const uint32_t index = find_node(str);
+                if (index == NONE || !nodes[index].terminal) {
+                    return false;
+                }
+                nodes[index].terminal = false;
+                count--;
+                return true;
+            }
+
+            /**
+             * List strings in the set that start with a prefix
+             * @param prefix Prefix to look for
+             * @param limit Maximum number of strings to list
+             * @return Up to limit matching strings, in sorted order
+             */
+            [[nodiscard]] std::vector<std::string> find(const std::string_view prefix, const size_t limit) const {
+                std::vector<std::string> results;
+                if (const uint32_t index = find_node(prefix); index != NONE && limit != 0) {
+                    std::string str(prefix);
+                    collect(index, str, limit, results);
+                }
+                return results;
+            }
+
+            /**
+             * @return Number of strings in the set
+             */
+            [[nodiscard]] size_t size() const {
+                return count;
+            }
+    };
+
+    /**
+     * Sets of values that commands autocomplete from
+     */
+    enum index {
+        DB_COMMANDS, /**< Names of text and embed DB commands */
+        EMBED_COMMANDS, /**< Names of embed DB commands */
+        WARNINGS, /**< IDs of active warnings, each after the ID of its server and a colon */
+        APPEALS, /**< IDs of users with pending ban appeals */
+        APPLICATIONS, /**< IDs of users with pending staff applications */
+        INDEX_COUNT /**< Number of indexes */
+    };
+
+    /**
+     * Fill the indexes, and keep the ones that come from the DB up to date with changes made outside the bot
+     * by reloading them regularly. The scheduler must be running.
+     * @param db SQLite DB pointer to load from
+     * @param text_commands Text DB commands
+     * @param embed_commands Embed DB commands
+     */
+    void start(sqlite3* db, const std::unordered_map<std::string, db_commands::text_command>& text_commands,
+               const std::unordered_map<std::string, db_commands::embed_command>& embed_commands);
+
+    /**
+     * Add a value to an index
+     * @param index Index to add to
+     * @param value Value to add
+     */
+    void add(index index, std::string_view value);
+
+    /**
+     * Remove a value from an index
+     * @param index Index to remove from
+     * @param value Value to remove
+     */
+    void remove(index index, std::string_view value);
+
+    /**
+     * Suggest values for the option being typed, from the index for the command
+     * @param event Autocomplete event to respond to
+     */
+    void on_autocomplete(const dpp::autocomplete_t& event);
+}
@@ -0,0 +1,31 @@
+/* builtin_command_names: Names of the built-in slash commands
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <string_view>
+
+namespace commands {
+    /**
+     * Every built-in slash command. main.cpp checks at compile time that its handler table has exactly these,
+     * so the dispatch benchmark always measures the real set.
+     */
+    inline constexpr std::array<std::string_view, 37> BUILTIN_COMMAND_NAMES = {
+        "add-text-command", "add-embed-command", "add-embed-command-field", "remove-embed-command-field",
+        "edit-embed-command-field", "remove-db-command", "db-command-list", "ping", "uptime", "commit", "db-stats",
+        "sendmessage", "announce", "dm", "remindme", "reminders", "set-bump-timer", "appeal-respond",
+        "application-respond", "rules", "rule", "suggest", "suggestion-respond", "create-ticket", "purge", "userinfo",
+        "inviteinfo", "warn", "unwarn", "mute", "unmute", "kick", "ban", "unban", "warnings", "search-records", "modstats"
+    };
+}
@@ -13,9 +13,49 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #include "db_commands.h"
+#include "../autocomplete.h"
 #include "../util.h"
+#include "../db.h"
 #include <sstream>
 
+/**
+ * Get the IDs of an embed command's fields in embed_command_fields
+ * @param db SQLite DB pointer to query
+ * @param command_name Name of the embed command
+ * @param field_ids String to append the comma-separated IDs to
+ * @return true if the query succeeded
+ */
+static bool get_field_ids(sqlite3* db, const std::string& command_name, std::string& field_ids) {
+    std::vector<std::tuple<std::string>> rows;
+    if (!db::query(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", util::sql_escape_string(command_name, true)), rows)) {
+        return false;
+    }
+    for (const auto& [fields] : rows) {
+        field_ids += fields;
+    }
+    return true;
+}
+
+/**
+ * Get the IDs of an embed command's fields in embed_command_fields
+ * @param db SQLite DB pointer to query
+ * @param command_name Name of the embed command
+ * @param field_ids Vector to append the IDs to
+ * @return true if the query succeeded
+ */
+static bool get_field_ids(sqlite3* db, const std::string& command_name, std::vector<int64_t>& field_ids) {
+    std::string field_list;
+    if (!get_field_ids(db, command_name, field_list)) {
+        return false;
+    }
+    std::istringstream field_stream(field_list);
+    std::string id;
+    while (std::getline(field_stream, id, ',')) {
+        field_ids.push_back(std::stoll(id));
+    }
+    return true;
+}
+
 void db_commands::add_text_command_modal(const dpp::slashcommand_t &event) {
     event.dialog(dpp::interaction_modal_response("add_text_command_form", "Add a text-based DB command")
         .add_component(dpp::component()
@@ -72,7 +112,7 @@ dpp::task<> db_commands::add_text_command(const dpp::form_submit_t &event, const
         co_return;
     }
     // Make sure command doesn't already exist
-    std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config, command_name);
+    std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config["guild_id"].get<dpp::snowflake>(), command_name);
     switch (search_result.first) {
         case util::GLOBAL_COMMAND_FOUND:
         case util::GUILD_COMMAND_FOUND:
@@ -119,17 +159,25 @@ dpp::task<> db_commands::add_text_command(const dpp::form_submit_t &event, const
 
     // Add command to command list
     text_commands.emplace(command_name, command);
+    util::uncache_reply(command_name);
+    autocomplete::add(autocomplete::DB_COMMANDS, command_name);
     // Build slash command
     dpp::slashcommand slash_command(
         command_name,
         command.description,
         event.owner->me.id
     );
+    dpp::confirmation_callback_t create_conf;
     if (command.global) {
         slash_command.set_dm_permission(true);
-        event.owner->global_command_create(slash_command);
+        create_conf = co_await event.owner->co_global_command_create(slash_command);
+    } else {
+        create_conf = co_await event.owner->co_guild_command_create(slash_command, config["guild_id"]);
+    }
+    if (create_conf.is_error()) {
+        util::log("ERROR", std::format("Failed to register command /{}: {}", command_name, create_conf.get_error().human_readable));
     } else {
-        event.owner->guild_command_create(slash_command, config["guild_id"]);
+        util::index_command(std::get<dpp::slashcommand>(create_conf.value), command.global);
     }
     // Send log
     dpp::embed embed = dpp::embed().set_color(util::color::GREEN).set_title("Database Command Added")
@@ -154,7 +202,7 @@ dpp::task<> db_commands::add_embed_command(const dpp::slashcommand_t &event, con
         co_return;
     }
     // Make sure command doesn't already exist
-    std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config, command_name);
+    std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config["guild_id"].get<dpp::snowflake>(), command_name);
     switch (search_result.first) {
         case util::GLOBAL_COMMAND_FOUND:
         case util::GUILD_COMMAND_FOUND:
@@ -304,17 +352,26 @@ dpp::task<> db_commands::add_embed_command(const dpp::slashcommand_t &event, con
 
     // Add command to command list
     embed_commands.emplace(command_name, command);
+    util::uncache_reply(command_name);
+    autocomplete::add(autocomplete::DB_COMMANDS, command_name);
+    autocomplete::add(autocomplete::EMBED_COMMANDS, command_name);
     // Build slash command
     dpp::slashcommand slash_command(
         command_name,
         command.description,
         event.owner->me.id
     );
+    dpp::confirmation_callback_t create_conf;
     if (command.global) {
         slash_command.set_dm_permission(true);
-        event.owner->global_command_create(slash_command);
+        create_conf = co_await event.owner->co_global_command_create(slash_command);
+    } else {
+        create_conf = co_await event.owner->co_guild_command_create(slash_command, config["guild_id"]);
+    }
+    if (create_conf.is_error()) {
+        util::log("ERROR", std::format("Failed to register command /{}: {}", command_name, create_conf.get_error().human_readable));
     } else {
-        event.owner->guild_command_create(slash_command, config["guild_id"]);
+        util::index_command(std::get<dpp::slashcommand>(create_conf.value), command.global);
     }
     // Send log
     dpp::embed embed = dpp::embed().set_color(util::color::GREEN).set_title("Database Command Added")
@@ -386,18 +443,7 @@ void db_commands::add_embed_command_field(const dpp::form_submit_t &event, std::
     std::string sql_command_name = util::sql_escape_string(command_name, true);
     std::string field_ids = "'";
     char* error_message;
-    sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", sql_command_name).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto output_string = static_cast<std::string*>(output);
-            if (column_values[0] != nullptr) {
-                output_string->append(column_values[0]);
-            }
-            return 0;
-        },
-    &field_ids, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!get_field_ids(db, command_name, field_ids)) {
         event.edit_original_response(dpp::message(std::format("Failed to find command `{}` in database.", command_name)));
         return;
     }
@@ -448,6 +494,7 @@ void db_commands::add_embed_command_field(const dpp::form_submit_t &event, std::
 
     // Add field to command in command list
     embed_commands.insert_or_assign(command_name, command);
+    util::uncache_reply(command_name);
     event.edit_original_response(dpp::message(std::format("Command `{}` edited successfully.", command_name)));
 }
 
@@ -463,35 +510,14 @@ void db_commands::remove_embed_command_field_menu(const dpp::slashcommand_t &eve
 
     // Get current field IDs from command in DB
     std::string field_ids;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", util::sql_escape_string(command_name, true)).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto field_ids = static_cast<std::string*>(output);
-            if (column_values[0] != nullptr) {
-                field_ids->append(column_values[0]);
-            }
-            return 0;
-        },
-    &field_ids, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!get_field_ids(db, command_name, field_ids)) {
         event.edit_original_response(dpp::message("Failed to get field from database."));
         return;
     }
 
     // Construct Discord select menu component with field titles
-    std::map<std::string, std::string> fields;
-    sqlite3_exec(db, std::format("SELECT id, title FROM embed_command_fields WHERE id IN ({});", field_ids).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto output_map = static_cast<std::map<std::string, std::string>*>(output);
-            output_map->emplace(column_values[0], column_values[1]);
-            return 0;
-        },
-    &fields, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<std::string, std::string>> fields;
+    if (!db::query(db, std::format("SELECT id, title FROM embed_command_fields WHERE id IN ({}) ORDER BY id;", field_ids), fields)) {
         event.edit_original_response(dpp::message("Failed to get field from database."));
         return;
     }
@@ -520,22 +546,7 @@ void db_commands::remove_embed_command_field(const dpp::select_click_t &event, s
     std::vector<int64_t> field_ids;
     // Get field IDs
     char* error_message;
-    sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", util::sql_escape_string(command_name, true)).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto output_vec = static_cast<std::vector<int64_t>*>(output);
-            if (column_values[0] != nullptr) {
-                std::istringstream field_ids(column_values[0]);
-                std::string id;
-                while (std::getline(field_ids, id, ',')) {
-                    output_vec->push_back(std::stoll(id));
-                }
-            }
-            return 0;
-        },
-    &field_ids, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!get_field_ids(db, command_name, field_ids)) {
         event.edit_response("Failed to get field from database.");
         return;
     }
@@ -591,6 +602,7 @@ void db_commands::remove_embed_command_field(const dpp::select_click_t &event, s
     // Remove field from command in command list
     command.embed.fields.erase(command.embed.fields.begin() + field_index);
     embed_commands.insert_or_assign(command_name, command);
+    util::uncache_reply(command_name);
     event.edit_response(std::format("Command `{}` edited successfully.", command_name));
 }
 
@@ -606,35 +618,14 @@ void db_commands::edit_embed_command_field_menu(const dpp::slashcommand_t &event
 
     // Get current field IDs from command in DB
     std::string field_ids;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", util::sql_escape_string(command_name, true)).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto field_ids = static_cast<std::string*>(output);
-            if (column_values[0] != nullptr) {
-                field_ids->append(column_values[0]);
-            }
-            return 0;
-        },
-    &field_ids, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!get_field_ids(db, command_name, field_ids)) {
         event.edit_original_response(dpp::message("Failed to get field from database."));
         return;
     }
 
     // Construct Discord select menu component with field titles
-    std::map<std::string, std::string> fields;
-    sqlite3_exec(db, std::format("SELECT id, title FROM embed_command_fields WHERE id IN ({});", field_ids).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto output_map = static_cast<std::map<std::string, std::string>*>(output);
-            output_map->emplace(column_values[0], column_values[1]);
-            return 0;
-        },
-    &fields, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<std::string, std::string>> fields;
+    if (!db::query(db, std::format("SELECT id, title FROM embed_command_fields WHERE id IN ({}) ORDER BY id;", field_ids), fields)) {
         event.edit_original_response(dpp::message("Failed to get field from database."));
         return;
     }
@@ -659,23 +650,12 @@ void db_commands::edit_embed_command_field_modal(const dpp::select_click_t &even
     context >> command_name;
 
     // Get selected field info
-    char* error_message;
-    std::string field[3];
-    sqlite3_exec(db, std::format("SELECT title, value, is_inline FROM embed_command_fields WHERE id = {};", field_id).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto field = static_cast<std::string*>(output);
-            field[0] = column_values[0];
-            field[1] = column_values[1];
-            field[2] = column_values[2];
-            return 0;
-        },
-    field, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<std::string, std::string, std::string>> fields;
+    if (!db::query(db, std::format("SELECT title, value, is_inline FROM embed_command_fields WHERE id = {};", field_id), fields) || fields.empty()) {
         event.reply("Failed to get field from database.");
         return;
     }
+    const auto& [title, value, is_inline] = fields[0];
 
     event.dialog(dpp::interaction_modal_response(std::format("edit_field_form{}{}", field_id, command_name), std::string("Edit a field in ") + command_name)
         .add_component(dpp::component()
@@ -684,7 +664,7 @@ void db_commands::edit_embed_command_field_modal(const dpp::select_click_t &even
             .set_type(dpp::cot_text)
             .set_min_length(1)
             .set_max_length(256)
-            .set_default_value(field[0])
+            .set_default_value(title)
             .set_text_style(dpp::text_short)
         ).add_row()
         .add_component(dpp::component()
@@ -693,7 +673,7 @@ void db_commands::edit_embed_command_field_modal(const dpp::select_click_t &even
             .set_type(dpp::cot_text)
             .set_min_length(1)
             .set_max_length(1024)
-            .set_default_value(field[1])
+            .set_default_value(value)
             .set_text_style(dpp::text_paragraph)
         ).add_row()
         .add_component(dpp::component()
@@ -702,7 +682,7 @@ void db_commands::edit_embed_command_field_modal(const dpp::select_click_t &even
             .set_type(dpp::cot_text)
             .set_min_length(4)
             .set_max_length(5)
-            .set_placeholder(std::string("Enter 'true' or 'false' (field is currently ") + field[2] + ')')
+            .set_placeholder(std::string("Enter 'true' or 'false' (field is currently ") + is_inline + ')')
             .set_default_value("")
             .set_text_style(dpp::text_short)
         )
@@ -743,22 +723,7 @@ void db_commands::edit_embed_command_field(const dpp::form_submit_t &event, std:
 
     std::vector<int64_t> field_ids;
     // Get field IDs for command
-    sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};", util::sql_escape_string(command_name, true)).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto output_vec = static_cast<std::vector<int64_t>*>(output);
-            if (column_values[0] != nullptr) {
-                std::istringstream field_ids(column_values[0]);
-                std::string id;
-                while (std::getline(field_ids, id, ',')) {
-                    output_vec->push_back(std::stoll(id));
-                }
-            }
-            return 0;
-        },
-    &field_ids, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!get_field_ids(db, command_name, field_ids)) {
         event.edit_response("Failed to get field from database.");
         return;
     }
@@ -779,6 +744,7 @@ void db_commands::edit_embed_command_field(const dpp::form_submit_t &event, std:
     command.embed.fields[field_index].value = value;
     command.embed.fields[field_index].is_inline = (is_inline == "'true'");
     embed_commands.insert_or_assign(command_name, command);
+    util::uncache_reply(command_name);
     event.edit_response(std::format("Command `{}` edited successfully.", command_name));
 }
 
@@ -803,7 +769,7 @@ dpp::task<> db_commands::remove_command(const dpp::slashcommand_t &event, const
         }
 
         // Remove slash command
-        std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config, command_name);
+        std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config["guild_id"].get<dpp::snowflake>(), command_name);
         if (search_result.first == util::GLOBAL_COMMAND_FOUND) {
             event.owner->global_command_delete(search_result.second);
         } else if (search_result.first == util::GUILD_COMMAND_FOUND) {
@@ -813,7 +779,10 @@ dpp::task<> db_commands::remove_command(const dpp::slashcommand_t &event, const
             event.edit_original_response(dpp::message(std::format("Failed to remove command `{}` from Discord.", command_name)));
             co_return;
         }
+        util::unindex_command(command_name);
         text_commands.erase(text_command_it);
+        util::uncache_reply(command_name);
+        autocomplete::remove(autocomplete::DB_COMMANDS, command_name);
 
         // Send log
         dpp::embed embed = dpp::embed().set_color(util::color::RED).set_title("Database Command Removed")
@@ -830,19 +799,7 @@ dpp::task<> db_commands::remove_command(const dpp::slashcommand_t &event, const
         // Get fields that are part of this embed command
         std::string fields;
         char* error_message;
-        sqlite3_exec(db, std::format("SELECT fields FROM embed_commands WHERE command_name={};",
-        util::sql_escape_string(command_name, true)).c_str(),
-            [](void* output, int column_count, char** column_values, char** column_names) -> int {
-                auto fields = static_cast<std::string*>(output);
-                if (column_values[0] != nullptr) {
-                    fields->append(column_values[0]);
-                }
-                return 0;
-            },
-        &fields, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
+        if (!get_field_ids(db, command_name, fields)) {
             co_await thinking;
             event.edit_original_response(dpp::message(std::format("Failed to remove command `{}` from database.", command_name)));
             co_return;
@@ -869,7 +826,7 @@ dpp::task<> db_commands::remove_command(const dpp::slashcommand_t &event, const
         }
 
         // Remove slash command
-        std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config, command_name);
+        std::pair<util::command_search_result, dpp::snowflake> search_result = co_await util::find_command(event.owner, config["guild_id"].get<dpp::snowflake>(), command_name);
         if (search_result.first == util::GLOBAL_COMMAND_FOUND) {
             event.owner->global_command_delete(search_result.second);
         } else if (search_result.first == util::GUILD_COMMAND_FOUND) {
@@ -879,7 +836,11 @@ dpp::task<> db_commands::remove_command(const dpp::slashcommand_t &event, const
             event.edit_original_response(dpp::message(std::format("Failed to remove command `{}` from Discord.", command_name)));
             co_return;
         }
+        util::unindex_command(command_name);
         embed_commands.erase(embed_command_it);
+        util::uncache_reply(command_name);
+        autocomplete::remove(autocomplete::DB_COMMANDS, command_name);
+        autocomplete::remove(autocomplete::EMBED_COMMANDS, command_name);
 
         // Send log
         dpp::embed embed = dpp::embed().set_color(util::color::RED).set_title("Database Command Removed")
@@ -13,7 +13,9 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #include "meta.h"
+#include "../autocomplete.h"
 #include "../util.h"
+#include "../db.h"
 
 void meta::ping(const dpp::slashcommand_t &event) {
     event.reply(std::format("Pong! {:.4g} ms", event.from()->websocket_ping * 1000));
@@ -24,6 +26,28 @@ void meta::uptime(const dpp::slashcommand_t &event) {
     event.reply(std::string("Up for ") + util::seconds_to_fancytime(uptime, 4));
 }
 
+void meta::db_stats(const dpp::slashcommand_t &event) {
+    std::vector<std::pair<std::string, db::query_stats>> stats = db::get_query_stats();
+    uint64_t total_count = 0, total_ns = 0;
+    for (const db::query_stats& query : stats | std::views::values) {
+        total_count += query.count;
+        total_ns += query.total_ns;
+    }
+    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title("Database Statistics")
+    .set_description(std::format("{} queries run across {} distinct statements, taking {:.1f} ms in total.",
+                                 total_count, stats.size(), total_ns / 1e6));
+    // Show the statements that have taken the most time overall.
+    // Each is cut to 450 characters so all 10 fit in Discord's 6000 character embed total.
+    for (size_t i = 0; i < stats.size() && i < 10; i++) {
+        const auto& [statement, query] = stats[i];
+        embed.add_field(std::format("#{}: {:.1f} ms total", i + 1, query.total_ns / 1e6), std::format(
+        "```sql\n{}```{} runs, {} rows, {:.2f} ms average, {:.2f} ms max",
+        statement.size() > 450 ? statement.substr(0, 450) + "..." : statement,
+        query.count, query.rows, query.total_ns / 1e6 / query.count, query.max_ns / 1e6), false);
+    }
+    event.reply(dpp::message(event.command.channel_id, embed).set_flags(dpp::m_ephemeral));
+}
+
 void meta::get_commit(const dpp::slashcommand_t &event) {
     // Show "thinking" status in case git takes more than 500ms to run
     event.thinking(true);
@@ -120,7 +144,7 @@ dpp::task<> meta::dm(const dpp::slashcommand_t &event, const nlohmann::json &con
     event.edit_original_response(dpp::message("Direct message sent successfully."));
 }
 
-void meta::remindme(const dpp::slashcommand_t &event, sqlite3* db) {
+void meta::remindme(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     event.thinking(true);
     const time_t now = time(nullptr);
@@ -138,6 +162,7 @@ void meta::remindme(const dpp::slashcommand_t &event, sqlite3* db) {
     reminder.start_time = now;
     reminder.end_time = now + seconds;
     reminder.user = event.command.get_issuing_user().id;
+    reminder.guild = typed_config.guild_id;
     try {
         reminder.text = std::get<std::string>(event.get_parameter("reminder"));
         // Replace escaped newline "\\n" with actual newline character
@@ -147,8 +172,9 @@ void meta::remindme(const dpp::slashcommand_t &event, sqlite3* db) {
     }
     // Add reminder to DB
     char* error_message;
-    sqlite3_exec(db, std::format("INSERT INTO reminders VALUES (NULL, {}, {}, '{}', {});", reminder.start_time, reminder.end_time,
-    reminder.user.str(), util::sql_escape_string(reminder.text, true)).c_str(), nullptr, nullptr, &error_message);
+    sqlite3_exec(db, std::format("INSERT INTO reminders(start_time, end_time, user, text, guild) VALUES ({}, {}, '{}', {}, '{}');",
+    reminder.start_time, reminder.end_time, reminder.user.str(), util::sql_escape_string(reminder.text, true), reminder.guild.str()).c_str(),
+    nullptr, nullptr, &error_message);
     if (error_message != nullptr) {
         util::log("SQL ERROR", error_message);
         sqlite3_free(error_message);
@@ -157,21 +183,52 @@ void meta::remindme(const dpp::slashcommand_t &event, sqlite3* db) {
     }
     reminder.id = sqlite3_last_insert_rowid(db);
 
-    // Sleep (on another thread) for reminder duration
+    // Schedule the reminder notification
     util::remind(event.owner, db, reminder);
     // Let log and user know the timer started
     std::string fancytime = util::seconds_to_fancytime(seconds, 4);
     util::log("INFO", std::format("Starting reminder of {} from {}",
     fancytime, event.command.get_issuing_user().username));
     event.edit_original_response(dpp::message(std::format(
-    "I will remind you in {} (<t:{}:F>).", fancytime, reminder.end_time)));
+    "I will remind you in {} (<t:{}:F>). To cancel it, use `/reminders cancel:{}`.", fancytime, reminder.end_time, reminder.id)));
 }
 
-void meta::set_bump_timer(const dpp::slashcommand_t &event, const nlohmann::json &config, bool& bump_timer_running) {
-    if (bump_timer_running) {
-        event.reply(dpp::message("The bump timer is already running.").set_flags(dpp::m_ephemeral));
+void meta::reminders(const dpp::slashcommand_t &event, sqlite3* db) {
+    // Send "thinking" response to allow time for DB operation
+    event.thinking(true);
+    const dpp::snowflake user = event.command.get_issuing_user().id;
+    // Cancel a reminder if an ID was given
+    try {
+        const int64_t id = std::get<int64_t>(event.get_parameter("cancel"));
+        if (util::cancel_reminder(db, id, user)) {
+            util::log("INFO", std::format("{} cancelled reminder {}", event.command.get_issuing_user().username, id));
+            event.edit_original_response(dpp::message(std::format("Reminder {} cancelled.", id)));
+        } else {
+            event.edit_original_response(dpp::message(std::format("You don't have a reminder with ID {}.", id)));
+        }
+        return;
+    } catch (const std::bad_variant_access&) {}
+
+    // Otherwise, list the user's reminders from every server, soonest first, since they're all sent by DM
+    std::vector<util::reminder> reminders;
+    if (!db::query(db, std::format("SELECT id, start_time, end_time, user, text, guild FROM reminders WHERE user='{}' ORDER BY end_time LIMIT 25;",
+                                   user.str()), reminders)) {
+        event.edit_original_response(dpp::message("Failed to get reminders from DB."));
         return;
     }
+    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title("Your reminders");
+    if (reminders.empty()) {
+        embed.set_description("You don't have any reminders. Set one with `/remindme`.");
+    }
+    // 25 reminders cut to 200 characters each keeps the embed under Discord's 6000 character total
+    for (const util::reminder& reminder : reminders) {
+        embed.add_field(std::format("ID {}", reminder.id), std::format("<t:{}:F>\n{}", reminder.end_time,
+                        reminder.text.size() > 200 ? reminder.text.substr(0, 200) + "..." : reminder.text), false);
+    }
+    event.edit_original_response(dpp::message(event.command.channel_id, embed));
+}
+
+void meta::set_bump_timer(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db) {
     // Get timer length
     time_t minutes;
     try {
@@ -180,8 +237,10 @@ void meta::set_bump_timer(const dpp::slashcommand_t &event, const nlohmann::json
         minutes = 120;
     }
     // Start timer and send confirmation
-    bump_timer_running = true;
-    util::handle_bump(event.owner, config, event.command.channel_id, minutes * 60LL, bump_timer_running);
+    if (!util::start_bump_timer(event.owner, db, typed_config.guild_id, event.command.channel_id, minutes * 60LL)) {
+        event.reply(dpp::message("The bump timer is already running.").set_flags(dpp::m_ephemeral));
+        return;
+    }
     event.reply(dpp::message(std::format("Timer set for {} minutes.", minutes)).set_flags(dpp::m_ephemeral));
 }
 
@@ -195,35 +254,29 @@ void meta::appeal_respond(const dpp::slashcommand_t &event, sqlite3* db) {
     } else {
         status = "rejected";
     }
-    std::pair<int64_t, std::string> callback_data;
-    callback_data.first = 0;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT rowid, email FROM ban_appeals WHERE id='{}' AND status='pending';", id).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto data = static_cast<std::pair<int64_t, std::string>*>(output);
-            data->first = strtoll(column_values[0], nullptr, 10);
-            data->second.append(column_values[1]);
-            return 0;
-        },
-    &callback_data, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<int64_t, std::string>> appeals;
+    if (!db::query(db, std::format("SELECT rowid, email FROM ban_appeals WHERE id='{}' AND status='pending';", id), appeals)) {
         event.edit_original_response(dpp::message("Failed to get appeals from DB."));
         return;
     }
-    if (callback_data.first == 0) {
+    if (appeals.empty()) {
         event.edit_original_response(dpp::message("The user does not have any pending ban appeals."));
         return;
     }
-    sqlite3_exec(db, std::format("UPDATE ban_appeals SET status = '{}' WHERE rowid = {};", status, callback_data.first).c_str(), nullptr, nullptr, &error_message);
+    const auto& [rowid, email] = appeals.back();
+    char* error_message;
+    sqlite3_exec(db, std::format("UPDATE ban_appeals SET status = '{}' WHERE rowid = {};", status, rowid).c_str(), nullptr, nullptr, &error_message);
     if (error_message != nullptr) {
         util::log("SQL ERROR", error_message);
         sqlite3_free(error_message);
         event.edit_original_response(dpp::message("Failed to set appeal status in DB."));
         return;
     }
-    event.edit_original_response(dpp::message(std::format("The appeal was marked as {}. Remember to send an email to `{}` to notify the user.", status, callback_data.second)));
+    // The user might have other pending appeals, which are answered one at a time
+    if (appeals.size() == 1) {
+        autocomplete::remove(autocomplete::APPEALS, id);
+    }
+    event.edit_original_response(dpp::message(std::format("The appeal was marked as {}. Remember to send an email to `{}` to notify the user.", status, email)));
 }
 
 dpp::task<> meta::application_respond(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
@@ -236,30 +289,22 @@ dpp::task<> meta::application_respond(const dpp::slashcommand_t &event, const nl
     } else {
         status = "rejected";
     }
-    std::pair<int64_t, bool> callback_data;
-    callback_data.first = 0;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT rowid, type FROM staff_applications WHERE id='{}' AND status='pending';", id).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto data = static_cast<std::pair<int64_t, bool>*>(output);
-            data->first = strtoll(column_values[0], nullptr, 10);
-            data->second = strcmp(column_values[1], "mod");
-            return 0;
-        },
-    &callback_data, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<int64_t, std::string>> applications;
+    if (!db::query(db, std::format("SELECT rowid, type FROM staff_applications WHERE id='{}' AND status='pending';", id), applications)) {
         co_await thinking;
         event.edit_original_response(dpp::message("Failed to get staff applications from DB."));
         co_return;
     }
-    if (callback_data.first == 0) {
+    if (applications.empty()) {
         co_await thinking;
         event.edit_original_response(dpp::message("The user does not have any pending staff applications."));
         co_return;
     }
-    sqlite3_exec(db, std::format("UPDATE staff_applications SET status = '{}' WHERE rowid = {};", status, callback_data.first).c_str(), nullptr, nullptr, &error_message);
+    const int64_t rowid = std::get<0>(applications.back());
+    // Applications are either for moderator or support team
+    const bool support_team = std::get<1>(applications.back()) != "mod";
+    char* error_message;
+    sqlite3_exec(db, std::format("UPDATE staff_applications SET status = '{}' WHERE rowid = {};", status, rowid).c_str(), nullptr, nullptr, &error_message);
     if (error_message != nullptr) {
         util::log("SQL ERROR", error_message);
         sqlite3_free(error_message);
@@ -267,6 +312,9 @@ dpp::task<> meta::application_respond(const dpp::slashcommand_t &event, const nl
         event.edit_original_response(dpp::message("Failed to set application status in DB."));
         co_return;
     }
+    if (applications.size() == 1) {
+        autocomplete::remove(autocomplete::APPLICATIONS, id);
+    }
     if (status == "accepted") {
         // Get user
         dpp::confirmation_callback_t user_conf = co_await event.owner->co_user_get_cached(id);
@@ -279,7 +327,7 @@ dpp::task<> meta::application_respond(const dpp::slashcommand_t &event, const nl
 
         // Add role
         dpp::snowflake role;
-        if (callback_data.second) {
+        if (support_team) {
             role = config["role_ids"]["support_team"].get<dpp::snowflake>();
         } else {
             role = config["role_ids"]["trial_mod"].get<dpp::snowflake>();
@@ -294,7 +342,7 @@ dpp::task<> meta::application_respond(const dpp::slashcommand_t &event, const nl
         // Send notification
         uint32_t color;
         std::string message;
-        if (callback_data.second) {
+        if (support_team) {
             color = util::color::SUPPORT_TEAM_ROLE_COLOR;
             message = "Congratulations, your Support Team application has been accepted. You should now have the Support Team role, which will give you access to staff channels, as well as a *lot* more notifications.";
         } else {
@@ -13,6 +13,7 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #pragma once
+#include "../settings.h"
 #include <dpp/dpp.h>
 #include <sqlite3.h>
 
@@ -20,11 +21,13 @@ namespace meta {
     void ping(const dpp::slashcommand_t &event);
     void uptime(const dpp::slashcommand_t &event);
     void get_commit(const dpp::slashcommand_t &event);
+    void db_stats(const dpp::slashcommand_t &event);
     dpp::task<> send_message(const dpp::slashcommand_t &event);
     dpp::task<> dm(const dpp::slashcommand_t &event, const nlohmann::json &config);
     dpp::task<> announce(const dpp::slashcommand_t &event, const nlohmann::json &config);
-    void remindme(const dpp::slashcommand_t &event, sqlite3* db);
-    void set_bump_timer(const dpp::slashcommand_t &event, const nlohmann::json &config, bool& bump_timer_running);
+    void remindme(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db);
+    void reminders(const dpp::slashcommand_t &event, sqlite3* db);
+    void set_bump_timer(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db);
     void appeal_respond(const dpp::slashcommand_t &event, sqlite3* db);
     dpp::task<> application_respond(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
 }
\ No newline at end of file
@@ -13,8 +13,12 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #include "moderation.h"
+#include "../autocomplete.h"
 #include "../util.h"
+#include "../db.h"
+#include <sstream>
 #include <map>
+#include <numeric>
 
 dpp::task<> moderation::create_ticket(const dpp::slashcommand_t &event, const nlohmann::json &config) {
     // Send "thinking" response to allow time for Discord API
@@ -187,7 +191,7 @@ dpp::task<> moderation::inviteinfo(const dpp::slashcommand_t &event) {
     event.edit_original_response(dpp::message(embed));
 }
 
-dpp::task<> moderation::warn(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::warn(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -207,7 +211,7 @@ dpp::task<> moderation::warn(const dpp::slashcommand_t &event, const nlohmann::j
     // Replace escaped newline "\\n" with actual newline character
     util::escape_newlines(reason);
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.user_id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.user_id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(user.get_mention() + "'s rank is higher than or equal to yours, cannot warn."));
         co_return;
@@ -242,25 +246,18 @@ dpp::task<> moderation::warn(const dpp::slashcommand_t &event, const nlohmann::j
     event.owner->message_edit(log_message);
 
     // Add warning to DB
-    char* error_message;
-    sqlite3_exec(db, std::format("INSERT INTO mod_records VALUES ('{}', 'Warning', '{}', '{}', {}, 'true', NULL);",
-                                 log_message.id.str(),
-                                 event.command.get_issuing_user().id.str(),
-                                 user.user_id.str(),
-                                 util::sql_escape_string(reason, true)
-                     ).c_str(), nullptr, nullptr, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    db::mod_record record = {log_message.id, typed_config.guild_id, "Warning", event.command.get_issuing_user().id, user.user_id, reason, true};
+    if (!db::add_mod_record(db, record)) {
         co_await thinking;
         event.edit_original_response(dpp::message("User warned successfully, but failed to add DB entry."));
         co_return;
     }
+    autocomplete::add(autocomplete::WARNINGS, std::format("{}:{}", typed_config.guild_id.str(), log_message.id.str()));
     co_await thinking;
     event.edit_original_response(dpp::message("User warned successfully."));
 }
 
-dpp::task<> moderation::unwarn(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::unwarn(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     std::string reason = std::get<std::string>(event.get_parameter("reason"));
@@ -273,47 +270,34 @@ dpp::task<> moderation::unwarn(const dpp::slashcommand_t &event, const nlohmann:
         event.edit_original_response(dpp::message("Invalid warning message ID."));
         co_return;
     }
-    // Make sure warning exists in DB and get warn reason and associated user ID
-    dpp::snowflake user_id = 0;
-    std::string original_reason;
-    std::pair callback_data = {&user_id, &original_reason};
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT user, reason FROM mod_records WHERE id='{}';", id).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto data = static_cast<std::pair<dpp::snowflake*, std::string*>*>(output);
-            *data->first = strtoull(column_values[0], nullptr, 10);
-            data->second->append(column_values[1]);
-            return 0;
-        },
-    &callback_data, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    // Make sure warning exists in this server's records and get warn reason and associated user ID
+    std::vector<std::tuple<dpp::snowflake, std::string>> warnings;
+    if (!db::query(db, std::format("SELECT user, reason FROM mod_records WHERE id='{}' AND guild='{}' AND type='Warning';",
+                                   id, typed_config.guild_id.str()), warnings)) {
         co_await thinking;
         event.edit_original_response(dpp::message("Failed to get warning from DB."));
         co_return;
     }
-    if (user_id == 0) {
+    if (warnings.empty()) {
         co_await thinking;
         event.edit_original_response(dpp::message(std::string("Could not find warning with ID ") + id));
         co_return;
     }
+    const auto& [user_id, original_reason] = warnings[0];
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user_id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user_id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(std::format("Cannot remove warning on <@{}>, whose rank is higher than or equal to yours.", user_id.str())));
         co_return;
     }
 
     // Set warning inactive in DB
-    sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE id='{}';", id).c_str(), nullptr, nullptr, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (!db::remove_warning(db, typed_config.guild_id, user_id, strtoull(id.c_str(), nullptr, 10), event.command.get_issuing_user().id)) {
         co_await thinking;
         event.edit_original_response(dpp::message("Failed to set warning inactive in DB."));
         co_return;
     }
+    autocomplete::remove(autocomplete::WARNINGS, std::format("{}:{}", typed_config.guild_id.str(), id));
     // Create unwarn message and send DM to user
     dpp::embed dm_embed = dpp::embed().set_color(util::color::GREEN).set_title("Your warning has been removed.")
                                       .add_field("Original warning reason", original_reason, false)
@@ -345,7 +329,7 @@ dpp::task<> moderation::unwarn(const dpp::slashcommand_t &event, const nlohmann:
     event.edit_original_response(dpp::message("Warning removed successfully."));
 }
 
-dpp::task<> moderation::mute(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::mute(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -380,21 +364,37 @@ dpp::task<> moderation::mute(const dpp::slashcommand_t &event, const nlohmann::j
         reason = "No reason provided.";
     }
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.user_id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.user_id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(user.get_mention() + "'s rank is higher than or equal to yours, cannot mute."));
         co_return;
     }
 
-    // Add muted role to user and get time of this action
-    time_t now = time(nullptr);
-    dpp::confirmation_callback_t role_add_conf = co_await event.owner->co_guild_member_add_role(user.guild_id, user.user_id, config["role_ids"]["muted"]);
-    if (role_add_conf.is_error()) {
+    // Discord ends timeouts by itself, so they don't need a timer, but they can't be longer than 28 days
+    const bool timeout = config["mute_backend"] == "timeout";
+    if (timeout && seconds > 28 * 86400) {
         co_await thinking;
-        event.edit_original_response(dpp::message("Failed to add muted role to user."));
+        event.edit_original_response(dpp::message("Mutes can't be longer than 28 days."));
         co_return;
     }
-    util::mute mute = {0, user.user_id, now, now + seconds};
+    // Add muted role to user or time them out, and get time of this action
+    time_t now = time(nullptr);
+    if (timeout) {
+        dpp::confirmation_callback_t timeout_conf = co_await event.owner->co_guild_member_timeout(user.guild_id, user.user_id, now + seconds);
+        if (timeout_conf.is_error()) {
+            co_await thinking;
+            event.edit_original_response(dpp::message("Failed to time out user."));
+            co_return;
+        }
+    } else {
+        dpp::confirmation_callback_t role_add_conf = co_await event.owner->co_guild_member_add_role(user.guild_id, user.user_id, config["role_ids"]["muted"]);
+        if (role_add_conf.is_error()) {
+            co_await thinking;
+            event.edit_original_response(dpp::message("Failed to add muted role to user."));
+            co_return;
+        }
+    }
+    util::mute mute = {0, user.user_id, now, now + seconds, typed_config.guild_id};
 
     // Create mute message and send DM to user
     dpp::embed dm_embed = dpp::embed().set_color(util::color::RED)
@@ -411,7 +411,9 @@ dpp::task<> moderation::mute(const dpp::slashcommand_t &event, const nlohmann::j
         } else {
             event.edit_original_response(dpp::message("User muted successfully, but failed to create logs."));
         }
-        util::handle_mute(event.owner, db, config, mute);
+        if (!timeout) {
+            util::handle_mute(event.owner, db, mute);
+        }
         co_return;
     }
     dpp::message log_message = std::get<dpp::message>(log_conf.value);
@@ -428,38 +430,21 @@ dpp::task<> moderation::mute(const dpp::slashcommand_t &event, const nlohmann::j
     event.owner->message_edit(log_message);
 
     // Add mute to DB
-    char* error_message;
-    sqlite3_exec(db, std::format("INSERT INTO mutes VALUES (NULL, {}, {});",
-                                mute.start_time, mute.end_time).c_str(),
-                 nullptr, nullptr, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    db::mod_record record = {log_message.id, typed_config.guild_id, timeout ? "Timeout" : "Mute", event.command.get_issuing_user().id, mute.user, reason, true, 0, mute.start_time, mute.end_time};
+    if (!db::add_mod_record(db, record)) {
         co_await thinking;
         event.edit_original_response(dpp::message("User muted successfully, but failed to add DB entry."));
     } else {
-        mute.id = sqlite3_last_insert_rowid(db);
-        sqlite3_exec(db, std::format("INSERT INTO mod_records VALUES ('{}', 'Mute', '{}', '{}', {}, 'true', {});",
-                                     log_message.id.str(),
-                                     event.command.get_issuing_user().id.str(),
-                                     mute.user.str(),
-                                     util::sql_escape_string(reason, true),
-                                     mute.id
-                         ).c_str(), nullptr, nullptr, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
-            co_await thinking;
-            event.edit_original_response(dpp::message("User muted successfully, but failed to add DB entry."));
-        } else {
-            co_await thinking;
-            event.edit_original_response(dpp::message("User muted successfully."));
-        }
+        mute.id = record.extra_data;
+        co_await thinking;
+        event.edit_original_response(dpp::message("User muted successfully."));
+    }
+    if (!timeout) {
+        util::handle_mute(event.owner, db, mute);
     }
-    util::handle_mute(event.owner, db, config, mute);
 }
 
-dpp::task<> moderation::unmute(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::unmute(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -483,47 +468,46 @@ dpp::task<> moderation::unmute(const dpp::slashcommand_t &event, const nlohmann:
     } catch (const std::bad_variant_access&) {
         reason = "No reason provided.";
     }
-    // Make sure user is muted
+    // Make sure user is muted, by either backend, since mutes from before a backend change may still be in effect
     std::vector<dpp::snowflake> roles = user.get_roles();
-    if (std::ranges::find(roles, config["role_ids"]["muted"].get<dpp::snowflake>()) == roles.end()) {
+    const bool has_muted_role = std::ranges::find(roles, config["role_ids"]["muted"].get<dpp::snowflake>()) != roles.end();
+    const bool timed_out = user.is_communication_disabled();
+    if (!has_muted_role && !timed_out) {
         co_await thinking;
         event.edit_original_response(dpp::message(std::format("User {} is not muted.", user.get_mention())));
         co_return;
     }
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.user_id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.user_id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(std::format("Cannot unmute {}, whose rank is higher than or equal to yours.", user.get_mention())));
         co_return;
     }
 
-    // Remove mute role
-    dpp::confirmation_callback_t unmute_conf = co_await event.owner->co_guild_member_delete_role(user.guild_id, user.user_id, config["role_ids"]["muted"]);
-    if (unmute_conf.is_error()) {
-        co_await thinking;
-        event.edit_original_response(dpp::message(std::string("Failed to remove muted role from ") + user.get_mention()));
-        co_return;
+    // Remove mute role and timeout
+    if (has_muted_role) {
+        dpp::confirmation_callback_t unmute_conf = co_await event.owner->co_guild_member_delete_role(user.guild_id, user.user_id, config["role_ids"]["muted"]);
+        if (unmute_conf.is_error()) {
+            co_await thinking;
+            event.edit_original_response(dpp::message(std::string("Failed to remove muted role from ") + user.get_mention()));
+            co_return;
+        }
     }
-    // Get mute ID if it exists in DB
-    dpp::snowflake id = 0;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT id FROM mod_records WHERE user='{}' AND type='Mute' AND active='true';", user.user_id.str()).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto id = static_cast<dpp::snowflake*>(output);
-            *id = strtoull(column_values[0], nullptr, 10);
-            return 0;
-        },
-    &id, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    if (timed_out) {
+        dpp::confirmation_callback_t timeout_conf = co_await event.owner->co_guild_member_timeout_remove(user.guild_id, user.user_id);
+        if (timeout_conf.is_error()) {
+            co_await thinking;
+            event.edit_original_response(dpp::message(std::string("Failed to remove timeout of ") + user.get_mention()));
+            co_return;
+        }
     }
-    if (id != 0) {
-        // Set mute inactive in DB
-        sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE id='{}';", id.str()).c_str(), nullptr, nullptr, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
+    // Set mute inactive in DB if it exists there, and cancel its automatic unmute
+    std::vector<db::mod_record> records;
+    db::get_mod_records(db, typed_config.guild_id, user.user_id, records);
+    for (const db::mod_record& record : records) {
+        if ((record.type == "Mute" || record.type == "Timeout") && record.active) {
+            db::deactivate_mod_record(db, user.user_id, record.id);
+            util::cancel_mute(record.extra_data);
         }
     }
 
@@ -547,7 +531,7 @@ dpp::task<> moderation::unmute(const dpp::slashcommand_t &event, const nlohmann:
     event.edit_original_response(dpp::message("Mute removed successfully."));
 }
 
-dpp::task<> moderation::kick(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::kick(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -571,7 +555,7 @@ dpp::task<> moderation::kick(const dpp::slashcommand_t &event, const nlohmann::j
         reason = "No reason provided.";
     }
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(user.get_mention() + "'s rank is higher than or equal to yours, cannot kick."));
         co_return;
@@ -617,16 +601,8 @@ dpp::task<> moderation::kick(const dpp::slashcommand_t &event, const nlohmann::j
     event.owner->message_edit(log_message);
 
     // Add kick to DB
-    char* error_message;
-    sqlite3_exec(db, std::format("INSERT INTO mod_records VALUES ('{}', 'Kick', '{}', '{}', {}, 'true', NULL);",
-                                 log_message.id.str(),
-                                 event.command.get_issuing_user().id.str(),
-                                 user.id.str(),
-                                 util::sql_escape_string(reason, true)
-                     ).c_str(), nullptr, nullptr, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    db::mod_record record = {log_message.id, typed_config.guild_id, "Kick", event.command.get_issuing_user().id, user.id, reason, true};
+    if (!db::add_mod_record(db, record)) {
         co_await thinking;
         event.edit_original_response(dpp::message("User kicked successfully, but failed to add DB entry."));
         co_return;
@@ -635,7 +611,7 @@ dpp::task<> moderation::kick(const dpp::slashcommand_t &event, const nlohmann::j
     event.edit_original_response(dpp::message("User kicked successfully."));
 }
 
-dpp::task<> moderation::ban(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::ban(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -662,7 +638,7 @@ dpp::task<> moderation::ban(const dpp::slashcommand_t &event, const nlohmann::js
         co_return;
     }
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(user.get_mention() + "'s rank is higher than or equal to yours, cannot ban."));
         co_return;
@@ -713,17 +689,8 @@ dpp::task<> moderation::ban(const dpp::slashcommand_t &event, const nlohmann::js
     event.owner->message_edit(log_message);
 
     // Add ban to DB
-    char* error_message;
-    sqlite3_exec(db, std::format("INSERT INTO mod_records VALUES ('{}', 'Ban', '{}', '{}', {}, 'true', {});",
-                                 log_message.id.str(),
-                                 event.command.get_issuing_user().id.str(),
-                                 user.id.str(),
-                                 util::sql_escape_string(reason, true),
-                                 seconds
-                     ).c_str(), nullptr, nullptr, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    db::mod_record record = {log_message.id, typed_config.guild_id, "Ban", event.command.get_issuing_user().id, user.id, reason, true, seconds};
+    if (!db::add_mod_record(db, record)) {
         co_await thinking;
         event.edit_original_response(dpp::message("User banned successfully, but failed to add DB entry."));
         co_return;
@@ -732,7 +699,7 @@ dpp::task<> moderation::ban(const dpp::slashcommand_t &event, const nlohmann::js
     event.edit_original_response(dpp::message("User banned successfully."));
 }
 
-dpp::task<> moderation::unban(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db) {
+dpp::task<> moderation::unban(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     dpp::async thinking = event.co_thinking(true);
     // Get context variables
@@ -753,7 +720,7 @@ dpp::task<> moderation::unban(const dpp::slashcommand_t &event, const nlohmann::
         co_return;
     }
     // Check hierarchy
-    if (! co_await util::check_perms(event.owner, config, event.command.get_issuing_user().id, user.id)) {
+    if (! co_await util::check_perms(event.owner, typed_config, event.command.get_issuing_user().id, user.id)) {
         co_await thinking;
         event.edit_original_response(dpp::message(std::format("Cannot unmute {}, whose rank is higher than or equal to yours.", user.get_mention())));
         co_return;
@@ -766,26 +733,16 @@ dpp::task<> moderation::unban(const dpp::slashcommand_t &event, const nlohmann::
         event.edit_original_response(dpp::message(std::string("Failed to remove ban of ") + user.get_mention()));
         co_return;
     }
-    // Get ban ID if it exists in DB
-    dpp::snowflake id = 0;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT id FROM mod_records WHERE user='{}' AND type='Ban' AND active='true';", user.id.str()).c_str(),
-        [](void* output, int column_count, char** column_values, char** column_names) -> int {
-            auto id = static_cast<dpp::snowflake*>(output);
-            *id = strtoull(column_values[0], nullptr, 10);
-            return 0;
-        },
-    &id, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
-    }
-    if (id != 0) {
-        // Set ban inactive in DB
-        sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE id='{}';", id.str()).c_str(), nullptr, nullptr, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
+    // Set ban inactive in DB if it exists there
+    std::vector<db::mod_record> records;
+    db::get_mod_records(db, typed_config.guild_id, user.id, records);
+    for (const db::mod_record& record : records) {
+        if (record.type == "Ban" && record.active) {
+            db::deactivate_mod_record(db, user.id, record.id);
+        // The ban took away the muted role and ended any timeout, so a mute still marked active has nothing left to undo
+        } else if ((record.type == "Mute" || record.type == "Timeout") && record.active) {
+            db::deactivate_mod_record(db, user.id, record.id);
+            util::cancel_mute(record.extra_data);
         }
     }
 
@@ -809,92 +766,225 @@ dpp::task<> moderation::unban(const dpp::slashcommand_t &event, const nlohmann::
     event.edit_original_response(dpp::message("Ban removed successfully."));
 }
 
-void moderation::get_mod_actions(const dpp::slashcommand_t &event, sqlite3* db) {
+/**
+ * Number of actions shown per page of /warnings, which keeps each page's fields under the embed limit of 25
+ */
+static constexpr unsigned int MOD_ACTIONS_PER_PAGE = 4;
+
+/**
+ * Build one page of a user's moderation actions in a server, with buttons to move between pages
+ * @param db SQLite DB pointer to query
+ * @param embed Embed for the page, with its title and thumbnail already set
+ * @param guild ID of the server the actions were taken in
+ * @param user ID of user to get actions against
+ * @param cursor ID of the action just outside the page, or 0 for the first page
+ * @param forward Whether the page comes after the cursor or before it
+ * @param archived Whether to include archived actions
+ * @param start Position of the page's first action among all the user's actions
+ * @param moderator ID of moderator who ran the command, the only one allowed to change pages
+ * @param message Message to put the page and buttons in
+ * @return true if the page was loaded from the DB
+ */
+static bool build_mod_actions_page(sqlite3* db, dpp::embed embed, const dpp::snowflake guild, const dpp::snowflake user, const dpp::snowflake cursor, const bool forward,
+                                   const bool archived, const uint64_t start, const dpp::snowflake moderator, dpp::message& message) {
+    std::vector<db::mod_record> actions;
+    uint64_t total;
+    if (!db::get_mod_records_page(db, guild, user, cursor, forward, archived, MOD_ACTIONS_PER_PAGE, actions) ||
+        !db::count_mod_records(db, guild, user, archived, total)) {
+        return false;
+    }
+    embed.fields.clear();
+    if (actions.empty()) {
+        embed.set_description("No moderation actions found.");
+        message.add_embed(embed);
+        return true;
+    }
+    embed.set_description(std::format("Showing actions {}-{} of {}", start + 1, start + actions.size(), total));
+    // Add fields for each action attribute
+    for (const db::mod_record& action : actions) {
+        embed.add_field("ID", action.id.str(), false)
+             .add_field("Type", action.type, true)
+             .add_field("Reason", action.reason, true)
+             .add_field("Moderator User ID", action.moderator.str(), true)
+             // Discord ends timeouts without the bot marking them inactive
+             .add_field("Active", action.active && (action.type != "Timeout" || action.mute_end > time(nullptr)) ? "true" : "false", true);
+        if (action.type == "Mute" || action.type == "Timeout") {
+            embed.add_field("Muted for", util::seconds_to_fancytime(action.mute_end - action.mute_start, 4), true);
+        }
+    }
+    message.add_embed(embed);
+
+    // Each button carries the cursor for its page, so no state is kept between clicks
+    const uint64_t previous_start = start > MOD_ACTIONS_PER_PAGE ? start - MOD_ACTIONS_PER_PAGE : 0;
+    message.add_component(dpp::component()
+        .add_component(dpp::component().set_type(dpp::cot_button).set_style(dpp::cos_secondary).set_label("Previous")
+            .set_id(std::format("warnings_page {} 0 {} {} {:d} {}", user.str(), actions.front().id.str(), previous_start, archived, moderator.str()))
+            .set_disabled(start == 0))
+        .add_component(dpp::component().set_type(dpp::cot_button).set_style(dpp::cos_secondary).set_label("Next")
+            .set_id(std::format("warnings_page {} 1 {} {} {:d} {}", user.str(), actions.back().id.str(), start + actions.size(), archived, moderator.str()))
+            .set_disabled(start + actions.size() >= total))
+    );
+    return true;
+}
+
+void moderation::get_mod_actions(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db) {
     // Send "thinking" response to allow time for DB operation
     event.thinking();
     dpp::user user = event.command.get_resolved_user(std::get<dpp::snowflake>(event.get_parameter("user")));
-    // Get all actions against user
-    struct action {
-        dpp::snowflake id;
-        std::string type = "Unknown";
-        dpp::snowflake mod;
-        std::string reason = "No reason provided.";
-        bool active = false;
-        time_t mute_seconds = 0; // stays 0 if type != "Mute"
-    };
-    std::vector<action> actions;
-    char* error_message;
-    sqlite3_exec(db, std::format("SELECT id, type, moderator, reason, active, extra_data FROM mod_records WHERE user='{}';", user.id.str()).c_str(),
-        [](void* action_list, int column_count, char** column_values, char** column_names) -> int {
-            auto actions = static_cast<std::vector<action>*>(action_list);
-            action action;
-            action.id = strtoull(column_values[0], nullptr, 10);
-            if (column_values[1] != nullptr) {
-                action.type = column_values[1];
-            }
-            action.mod = strtoull(column_values[2], nullptr, 10);
-            if (column_values[3] != nullptr) {
-                action.reason = column_values[3];
-            }
-            if (column_values[4] != nullptr) {
-                action.active = strcmp("false", column_values[4]);
-            }
-            if (column_values[5] != nullptr && action.type == "Mute") {
-                // Temporarily store mute ext info ID in mute_seconds
-                action.mute_seconds = strtoll(column_values[5], nullptr, 10);
-            }
-            actions->push_back(action);
-            return 0;
-        },
-    &actions, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    bool archived;
+    try {
+        archived = std::get<bool>(event.get_parameter("archived"));
+    } catch (const std::bad_variant_access&) {
+        archived = false;
+    }
+
+    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_thumbnail(user.get_avatar_url())
+                                   .set_title(std::string("Moderation actions against ") + user.username);
+    dpp::message message(event.command.channel_id, "");
+    if (!build_mod_actions_page(db, embed, typed_config.guild_id, user.id, 0, true, archived, 0, event.command.get_issuing_user().id, message)) {
         event.edit_original_response(dpp::message("Failed to get warnings from DB."));
         return;
     }
-    // Get mute time for mute actions
-    for (action& mod_action : actions) {
-        if (mod_action.type == "Mute") {
-            sqlite3_exec(db, std::format("SELECT start_time, end_time FROM mutes WHERE id={};", mod_action.mute_seconds).c_str(),
-                [](void* output, int column_count, char** column_values, char** column_names) -> int {
-                    auto mod_action = static_cast<action*>(output);
-                    time_t start_time = strtoll(column_values[0], nullptr, 10);
-                    time_t end_time = strtoll(column_values[1], nullptr, 10);
-                    mod_action->mute_seconds = end_time - start_time;
-                    return 0;
-                },
-            &mod_action, &error_message);
-            if (error_message != nullptr) {
-                util::log("SQL ERROR", error_message);
-                sqlite3_free(error_message);
-                mod_action.mute_seconds = 0;
+    event.edit_original_response(message);
+}
+
+void moderation::change_mod_actions_page(const dpp::button_click_t &event, const settings::typed_config &typed_config, sqlite3* db) {
+    // Get context vars
+    uint64_t user, cursor, start, moderator;
+    bool forward, archived;
+    std::istringstream context(event.custom_id.substr(14));
+    context >> user >> forward >> cursor >> start >> archived >> moderator;
+    if (context.fail()) {
+        event.reply(dpp::message("This page's buttons are invalid, run the command again.").set_flags(dpp::m_ephemeral));
+        return;
+    }
+    if (event.command.get_issuing_user().id != moderator) {
+        event.reply(dpp::message("Only the moderator who ran this command can change its page.").set_flags(dpp::m_ephemeral));
+        return;
+    }
+
+    // Reuse the title and thumbnail of the page being replaced
+    dpp::embed embed = event.command.msg.embeds.empty() ? dpp::embed().set_color(util::color::DEFAULT) : event.command.msg.embeds[0];
+    dpp::message message;
+    if (!build_mod_actions_page(db, embed, typed_config.guild_id, user, cursor, forward, archived, start, moderator, message)) {
+        event.reply(dpp::message("Failed to get warnings from DB.").set_flags(dpp::m_ephemeral));
+        return;
+    }
+    event.reply(dpp::ir_update_message, message);
+}
+
+void moderation::search_records(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db) {
+    // Send "thinking" response to allow time for DB operation
+    event.thinking(true);
+    const std::string query = std::get<std::string>(event.get_parameter("query"));
+    std::string source;
+    try {
+        source = std::get<std::string>(event.get_parameter("in"));
+    } catch (const std::bad_variant_access&) {
+        source = "all";
+    }
+    // Ban appeals and staff applications are only sent to the main server
+    if (!typed_config.main_guild && source != "all" && source != "mod_records") {
+        event.edit_original_response(dpp::message("Ban appeals and staff applications can only be searched in the main server."));
+        return;
+    }
+
+    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title(std::string("Search results for ") + query);
+    // Up to 8 results from each table keeps all three within the 25 field limit
+    const std::vector<std::pair<db::search_source, std::string>> sources = {
+        {db::MOD_RECORDS, "mod_records"},
+        {db::BAN_APPEALS, "ban_appeals"},
+        {db::STAFF_APPLICATIONS, "staff_applications"}
+    };
+    for (const auto& [search_source, name] : sources) {
+        if ((source != "all" && source != name) || (!typed_config.main_guild && search_source != db::MOD_RECORDS)) {
+            continue;
+        }
+        std::vector<db::search_result> results;
+        if (!db::search_records(db, typed_config.guild_id, search_source, query, 8, results)) {
+            event.edit_original_response(dpp::message("Search failed. Check that the query is valid FTS5 syntax, e.g. `spam`, `\"free nitro\"`, or `scam OR phishing`."));
+            return;
+        }
+        for (const db::search_result& result : results) {
+            std::string title;
+            switch (search_source) {
+                case db::MOD_RECORDS:
+                    title = std::format("{} {}", result.kind, result.id);
+                    break;
+                case db::BAN_APPEALS:
+                    title = std::format("Ban appeal #{} ({})", result.id, result.kind);
+                    break;
+                case db::STAFF_APPLICATIONS:
+                    title = std::format("{} application #{}", result.kind, result.id);
+                    break;
             }
+            embed.add_field(title, std::format("<@{}>: {}", result.user.str(), result.snippet.substr(0, 1000)), false);
         }
     }
+    if (embed.fields.empty()) {
+        embed.set_description("No matches found.");
+    }
+    event.edit_original_response(dpp::message(event.command.channel_id, embed));
+}
 
-    // Print actions in groups of 4 because embeds can only have up to 25 fields
-    std::vector<dpp::embed> embeds((actions.size() + 3) / 4);
-    // Initialize embeds
-    embeds[0] = dpp::embed().set_color(util::color::DEFAULT).set_thumbnail(user.get_avatar_url())
-                            .set_title(std::string("Moderation actions against ") + user.username);
-    for (size_t i = 1; i < embeds.size(); i++) {
-        embeds[i] = dpp::embed().set_color(util::color::DEFAULT).set_title(user.username + "'s warnings continued");
+void moderation::mod_stats(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db) {
+    // Send "thinking" response to allow time for DB operation
+    event.thinking();
+    dpp::snowflake moderator = 0;
+    try {
+        moderator = std::get<dpp::snowflake>(event.get_parameter("moderator"));
+    } catch (const std::bad_variant_access&) {}
+    int64_t days;
+    try {
+        days = std::get<int64_t>(event.get_parameter("days"));
+    } catch (const std::bad_variant_access&) {
+        days = 30;
     }
-    // Add fields for each action attribute
-    for (size_t i = 0; i < actions.size(); i++) {
-        embeds[i / 4].add_field("ID", actions[i].id.str(), false)
-                     .add_field("Type", actions[i].type, true)
-                     .add_field("Reason", actions[i].reason, true)
-                     .add_field("Moderator User ID", actions[i].mod.str(), true)
-                     .add_field("Active", actions[i].active ? "true" : "false", true);
-        if (actions[i].type == "Mute") {
-            embeds[i / 4].add_field("Muted for", util::seconds_to_fancytime(actions[i].mute_seconds, 4), true);
+
+    std::vector<db::mod_stat> stats;
+    if (!db::get_mod_stats(db, typed_config.guild_id, moderator, days, stats)) {
+        event.edit_original_response(dpp::message("Failed to get moderation statistics from DB."));
+        return;
+    }
+    // Sum each moderator's counts, keeping the action types in a fixed order
+    static const std::array<std::string, 6> types = {"Warning", "Mute", "Timeout", "Kick", "Ban", "Unwarn"};
+    std::map<dpp::snowflake, std::array<uint64_t, types.size()>> totals;
+    for (const db::mod_stat& stat : stats) {
+        const auto type = std::ranges::find(types, stat.type);
+        if (type != types.end()) {
+            totals[stat.moderator][type - types.begin()] += stat.count;
         }
     }
-    // Send each embed
-    event.edit_original_response(dpp::message(event.command.channel_id, embeds[0]));
-    for (size_t i = 1; i < embeds.size(); i++) {
-        event.owner->message_create(dpp::message(event.command.channel_id, embeds[i]));
+    // Busiest moderators first
+    std::vector<std::pair<dpp::snowflake, std::array<uint64_t, types.size()>>> sorted(totals.begin(), totals.end());
+    std::ranges::sort(sorted, std::ranges::greater(), [](const auto& entry){return std::accumulate(entry.second.begin(), entry.second.end(), uint64_t(0));});
+
+    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT)
+                                   .set_title(std::format("Moderation actions in the last {} day{}", days, days == 1 ? "" : "s"));
+    if (moderator != 0) {
+        dpp::user* user = dpp::find_user(moderator);
+        embed.set_description(std::format("Taken by <@{}>", moderator.str()));
+        if (user != nullptr) {
+            embed.set_thumbnail(user->get_avatar_url());
+        }
+        for (size_t i = 0; i < types.size(); i++) {
+            embed.add_field(types[i], std::to_string(sorted.empty() ? 0 : sorted[0].second[i]), true);
+        }
+    } else if (sorted.empty()) {
+        embed.set_description("No moderation actions found.");
+    } else {
+        // Leave room under the 25 field limit
+        for (size_t i = 0; i < sorted.size() && i < 24; i++) {
+            const auto& [id, counts] = sorted[i];
+            std::string value = std::format("<@{}>\n", id.str());
+            for (size_t j = 0; j < types.size(); j++) {
+                value += std::format("{}: {}{}", types[j], counts[j], j + 1 < types.size() ? ", " : "");
+            }
+            embed.add_field(std::format("#{}", i + 1), value, false);
+        }
+        if (sorted.size() > 24) {
+            embed.set_footer(dpp::embed_footer().set_text(std::format("{} more moderators not shown", sorted.size() - 24)));
+        }
     }
-}
\ No newline at end of file
+    event.edit_original_response(dpp::message(event.command.channel_id, embed));
+}
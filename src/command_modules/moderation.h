@@ -13,6 +13,7 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #pragma once
+#include "../settings.h"
 #include <sqlite3.h>
 #include <dpp/dpp.h>
 
@@ -21,12 +22,15 @@ namespace moderation {
     dpp::task<> purge(const dpp::slashcommand_t &event, const nlohmann::json &config);
     void userinfo(const dpp::slashcommand_t &event, const nlohmann::json &config);
     dpp::task<> inviteinfo(const dpp::slashcommand_t &event);
-    dpp::task<> warn(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> unwarn(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> mute(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> unmute(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> kick(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> ban(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    dpp::task<> unban(const dpp::slashcommand_t &event, const nlohmann::json &config, sqlite3* db);
-    void get_mod_actions(const dpp::slashcommand_t &event, sqlite3* db);
+    dpp::task<> warn(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> unwarn(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> mute(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> unmute(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> kick(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> ban(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    dpp::task<> unban(const dpp::slashcommand_t &event, const nlohmann::json &config, const settings::typed_config &typed_config, sqlite3* db);
+    void get_mod_actions(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db);
+    void change_mod_actions_page(const dpp::button_click_t &event, const settings::typed_config &typed_config, sqlite3* db);
+    void search_records(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db);
+    void mod_stats(const dpp::slashcommand_t &event, const settings::typed_config &typed_config, sqlite3* db);
 }
\ No newline at end of file
@@ -16,13 +16,15 @@
 #include "../util.h"
 
 void server_info::rules(const dpp::slashcommand_t &event, const nlohmann::json &config) {
-    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title("Server Rules");
+    util::reply_cached(event, "rules", [&config] {
+        dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title("Server Rules");
 
-    for (size_t i = 0; i < config["rules"].size(); i++) {
-        embed.add_field(std::format("Rule {}:", i + 1), config["rules"][i].get<std::string>());
-    }
+        for (size_t i = 0; i < config["rules"].size(); i++) {
+            embed.add_field(std::format("Rule {}:", i + 1), config["rules"][i].get<std::string>());
+        }
 
-    event.reply(dpp::message(event.command.channel_id, embed));
+        return dpp::message(embed);
+    }, &config);
 }
 
 void server_info::rule(const dpp::slashcommand_t &event, const nlohmann::json &config) {
@@ -32,10 +34,12 @@ void server_info::rule(const dpp::slashcommand_t &event, const nlohmann::json &c
         return;
     }
 
-    dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT)
-                                   .set_title(std::string("Rule ") + std::to_string(rule))
-                                   .set_description(config["rules"][rule - 1].get<std::string>());
-    event.reply(dpp::message(event.command.channel_id, embed));
+    util::reply_cached(event, std::format("rule:{}", rule), [&config, rule] {
+        dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT)
+                                       .set_title(std::string("Rule ") + std::to_string(rule))
+                                       .set_description(config["rules"][rule - 1].get<std::string>());
+        return dpp::message(embed);
+    }, &config);
 }
 
 void server_info::suggest(const dpp::slashcommand_t &event, const nlohmann::json &config) {
@@ -54,7 +58,7 @@ dpp::task<> server_info::suggestion_response(const dpp::slashcommand_t &event, c
     // Send "thinking" response to allow time for Discord API
     dpp::async thinking = event.co_thinking();
     dpp::snowflake message_id = std::stoull(std::get<std::string>(event.get_parameter("suggestion_id")));
-    dpp::confirmation_callback_t suggestion = co_await util::get_message_cached(event.owner, message_id, config["log_channel_ids"]["suggestion_list"]);
+    dpp::confirmation_callback_t suggestion = co_await util::get_message_cached(event.owner, config["guild_id"], message_id, config["log_channel_ids"]["suggestion_list"]);
     if (suggestion.is_error()) {
         co_await thinking;
         event.edit_original_response(dpp::message("Suggestion message not found."));
@@ -0,0 +1,103 @@
+/* command_table: Compile-time perfect hash of command names to handlers
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+namespace commands {
+    /**
+     * Fixed set of names mapped to handlers, looked up with a perfect hash that's found at compile time.
+     * Every name hashes to its own slot, so a lookup is one hash and at most one string compare, whether
+     * or not the name is in the table.
+     * @tparam Handler Type of the handlers
+     * @tparam N Number of names
+     */
+    template <typename Handler, size_t N>
+    class command_table {
+        static constexpr size_t SLOTS = std::bit_ceil(N) * 8; /**< Number of hash slots, sparse enough that a seed is quick to find */
+
+        std::array<std::pair<std::string_view, Handler>, N> entries; /**< Names and handlers */
+        std::array<uint8_t, SLOTS> slots{}; /**< Index of the entry in each slot plus one, or 0 if it's empty */
+        uint32_t seed = 0; /**< Hash seed that gives every name its own slot */
+
+        /**
+         * FNV-1a hash of a name
+         * @param name Name to hash
+         * @param seed Seed mixed into the starting value
+         * @return Slot the name goes in
+         */
+        static constexpr size_t slot(const std::string_view name, const uint32_t seed) {
+            uint32_t hash = 2166136261u ^ seed * 16777619u;
+            for (const char c : name) {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 16777619u;
+            }
+            return (hash ^ hash >> 16) & (SLOTS - 1);
+        }
+
+        public:
+            static_assert(N < 256, "Slot indices are stored in a uint8_t");
+
+            /**
+             * Build the table, trying seeds until there are no collisions. Fails to compile if a name is repeated.
+             * @param entries Names and their handlers, in any order
+             */
+            consteval explicit command_table(const std::array<std::pair<std::string_view, Handler>, N>& entries) : entries(entries) {
+                for (size_t i = 0; i < N; i++) {
+                    for (size_t j = 0; j < i; j++) {
+                        if (entries[i].first == entries[j].first) {
+                            throw "Duplicate command name";
+                        }
+                    }
+                }
+                for (;; seed++) {
+                    slots.fill(0);
+                    size_t placed = 0;
+                    for (; placed < N; placed++) {
+                        uint8_t& index = slots[slot(entries[placed].first, seed)];
+                        if (index != 0) {
+                            break;
+                        }
+                        index = placed + 1;
+                    }
+                    if (placed == N) {
+                        return;
+                    }
+                }
+            }
+
+            /**
+             * Look up a name
+             * @param name Name to look up
+             * @return Pointer to the name's handler, or nullptr if it isn't in the table
+             */
+            [[nodiscard]] constexpr const Handler* find(const std::string_view name) const {
+                const uint8_t index = slots[slot(name, seed)];
+                if (index == 0 || entries[index - 1].first != name) {
+                    return nullptr;
+                }
+                return &entries[index - 1].second;
+            }
+
+            /**
+             * @return Number of names in the table
+             */
+            [[nodiscard]] static constexpr size_t size() {
+                return N;
+            }
+    };
+}
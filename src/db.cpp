@@ -0,0 +1,800 @@
+/* db: Shared database queries
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "db.h"
+#include <condition_variable>
+
+/**
+ * Get moderation records matching a condition, joined with their mute times in a single query
+ * @param db SQLite DB pointer to query
+ * @param schema Schema to read mod_records and mutes from (main or archive)
+ * @param condition SQL expression for the WHERE clause, optionally followed by ORDER BY and LIMIT clauses
+ * @param records Vector to append the records to
+ * @return true if the query succeeded
+ */
+static bool query_mod_records(sqlite3* db, const std::string_view schema, const std::string_view condition, std::vector<db::mod_record>& records) {
+    // Mute times are NULL unless this is a mute or timeout with a row in the mutes table
+    return db::query(db, std::format("SELECT r.id, r.guild, type, moderator, user, reason, active, extra_data, m.start_time, m.end_time "
+                                     "FROM {0}.mod_records r LEFT JOIN {0}.mutes m ON r.type IN ('Mute', 'Timeout') AND m.id = r.extra_data "
+                                     "WHERE {1};", schema, condition), records);
+}
+
+bool db::get_mod_records(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake user, std::vector<mod_record>& records) {
+    // The cache holds the user's records from every server, so one entry serves all of them
+    std::vector<mod_record> all;
+    if (!MOD_RECORD_CACHE.get(user, all, [db, user](std::vector<mod_record>& loaded) {
+        return query_mod_records(db, "main", std::format("user='{}'", user.str()), loaded);
+    })) {
+        return false;
+    }
+    std::ranges::copy_if(all, std::back_inserter(records), [guild](const mod_record& record){return record.guild == guild;});
+    return true;
+}
+
+bool db::get_archived_mod_records(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake user, std::vector<mod_record>& records) {
+    return query_mod_records(db, "archive", std::format("r.guild='{}' AND user='{}'", guild.str(), user.str()), records);
+}
+
+bool db::get_mod_records_page(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake user, const dpp::snowflake cursor, const bool forward,
+                              const bool archived, const unsigned int limit, std::vector<mod_record>& records) {
+    std::string condition = std::format("r.guild='{}' AND user='{}'", guild.str(), user.str());
+    if (cursor != 0) {
+        condition += std::format(" AND CAST(r.id AS INTEGER) {} {}", forward ? '>' : '<', static_cast<uint64_t>(cursor));
+    }
+    condition += std::format(" ORDER BY CAST(r.id AS INTEGER) {} LIMIT {}", forward ? "ASC" : "DESC", limit);
+
+    std::vector<mod_record> page;
+    if (!query_mod_records(db, "main", condition, page) || (archived && !query_mod_records(db, "archive", condition, page))) {
+        return false;
+    }
+    // Each schema can return a full page, so keep the records closest to the cursor
+    std::ranges::sort(page, [](const mod_record& a, const mod_record& b){
+        return static_cast<uint64_t>(a.id) < static_cast<uint64_t>(b.id);
+    });
+    if (page.size() > limit) {
+        if (forward) {
+            page.erase(page.begin() + limit, page.end());
+        } else {
+            page.erase(page.begin(), page.end() - limit);
+        }
+    }
+    records.insert(records.end(), page.begin(), page.end());
+    return true;
+}
+
+bool db::count_mod_records(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake user, const bool archived, uint64_t& count) {
+    std::vector<std::tuple<uint64_t>> counts;
+    const std::string condition = std::format("guild='{}' AND user='{}'", guild.str(), user.str());
+    std::string sql = std::format("SELECT count(*) FROM main.mod_records WHERE {}", condition);
+    if (archived) {
+        sql += std::format(" UNION ALL SELECT count(*) FROM archive.mod_records WHERE {}", condition);
+    }
+    if (!query(db, sql, counts)) {
+        return false;
+    }
+    count = 0;
+    for (const auto& [schema_count] : counts) {
+        count += schema_count;
+    }
+    return true;
+}
+
+/**
+ * Get the UTC day number, counted from the Unix epoch, that a snowflake was created on
+ * @param id Snowflake to get the day of
+ * @return Days since 1970-01-01
+ */
+static int64_t snowflake_day(const dpp::snowflake id) {
+    // Snowflakes store their creation time in milliseconds since the Discord epoch in the bits above 22
+    return ((static_cast<uint64_t>(id) >> 22) + 1420070400000LL) / 86400000LL;
+}
+
+/**
+ * Run statements in a transaction, rolling back if any of them fail.
+ * The caller must hold the DB mutex so other threads' statements stay out of the transaction.
+ * @param db SQLite DB pointer to run the statements on
+ * @param statements Statements to run, without BEGIN or COMMIT
+ * @return true if the transaction was committed
+ */
+static bool exec_transaction(sqlite3* db, const std::string_view statements) {
+    char* error_message;
+    sqlite3_exec(db, std::format("BEGIN; {} COMMIT;", statements).c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Statement adding one to a moderator's count of an action type for a day in mod_stats
+ * @param day Day number from snowflake_day
+ * @param guild ID of the server the action was taken in
+ * @param moderator ID of moderator who took the action
+ * @param type Type of action
+ * @return INSERT statement
+ */
+static std::string count_mod_stat(const int64_t day, const dpp::snowflake guild, const dpp::snowflake moderator, const std::string_view type) {
+    return std::format("INSERT INTO mod_stats(day, guild, moderator, type, count) VALUES ({}, '{}', '{}', {}, 1) ON CONFLICT DO UPDATE SET count = count + 1;",
+                       day, guild.str(), moderator.str(), util::sql_escape_string(type, true));
+}
+
+bool db::add_mod_record(sqlite3* db, mod_record& record) {
+    char* error_message = nullptr;
+    // Hold the connection so no other thread's insert can change the last insert row ID or end up in the transaction
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr);
+    if (record.type == "Mute" || record.type == "Timeout") {
+        sqlite3_exec(db, std::format("INSERT INTO mutes(start_time, end_time, guild) VALUES ({}, {}, '{}');",
+                                     record.mute_start, record.mute_end, record.guild.str()).c_str(), nullptr, nullptr, &error_message);
+        record.extra_data = sqlite3_last_insert_rowid(db);
+    }
+    if (error_message == nullptr) {
+        sqlite3_exec(db, (std::format("INSERT INTO mod_records(id, type, moderator, user, reason, active, extra_data, guild) "
+                                      "VALUES ('{}', '{}', '{}', '{}', {}, '{}', {}, '{}');",
+                                      record.id.str(),
+                                      record.type,
+                                      record.moderator.str(),
+                                      record.user.str(),
+                                      util::sql_escape_string(record.reason, true),
+                                      record.active ? "true" : "false",
+                                      record.extra_data == 0 ? "NULL" : std::to_string(record.extra_data),
+                                      record.guild.str()
+                                     ) + count_mod_stat(snowflake_day(record.id), record.guild, record.moderator, record.type) + "COMMIT;"
+                         ).c_str(), nullptr, nullptr, &error_message);
+    }
+    if (error_message != nullptr) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_mutex_leave(sqlite3_db_mutex(db));
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return false;
+    }
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
+    MOD_RECORD_CACHE.add(record);
+    return true;
+}
+
+bool db::deactivate_mod_record(sqlite3* db, const dpp::snowflake user, const dpp::snowflake id) {
+    char* error_message;
+    sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE id='{}';", id.str()).c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return false;
+    }
+    MOD_RECORD_CACHE.deactivate(user, [id](const mod_record& record){return record.id == id;});
+    return true;
+}
+
+bool db::remove_warning(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake user, const dpp::snowflake id, const dpp::snowflake moderator) {
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    // Only count the removal if the warning was still active
+    const std::string condition = std::format("id='{}' AND guild='{}' AND type='Warning'", id.str(), guild.str());
+    std::vector<std::tuple<uint64_t>> active;
+    bool success = query(db, std::format("SELECT count(*) FROM mod_records WHERE {} AND active='true';", condition), active);
+    if (success) {
+        std::string statements = std::format("UPDATE mod_records SET active = 'false' WHERE {};", condition);
+        if (!active.empty() && std::get<0>(active[0]) != 0) {
+            statements += count_mod_stat(time(nullptr) / 86400, guild, moderator, "Unwarn");
+        }
+        success = exec_transaction(db, statements);
+    }
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
+    if (success) {
+        MOD_RECORD_CACHE.deactivate(user, [guild, id](const mod_record& record){
+            return record.id == id && record.guild == guild && record.type == "Warning";
+        });
+    }
+    return success;
+}
+
+bool db::get_mod_stats(sqlite3* db, const dpp::snowflake guild, const dpp::snowflake moderator, const unsigned int days, std::vector<mod_stat>& stats) {
+    // The primary key starts with day, so only the rollup rows in range are read
+    std::string condition = std::format("day > {} AND guild='{}'", time(nullptr) / 86400 - days, guild.str());
+    if (moderator != 0) {
+        condition += std::format(" AND moderator='{}'", moderator.str());
+    }
+    return query(db, std::format("SELECT moderator, type, sum(count) FROM mod_stats WHERE {} GROUP BY moderator, type;", condition), stats);
+}
+
+bool db::deactivate_mute(sqlite3* db, const util::mute& mute) {
+    char* error_message;
+    sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE type='Mute' AND extra_data={};", mute.id).c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return false;
+    }
+    MOD_RECORD_CACHE.deactivate(mute.user, [&mute](const mod_record& record){return record.type == "Mute" && record.extra_data == mute.id;});
+    return true;
+}
+
+bool db::get_active_mutes(sqlite3* db, const time_t since, const time_t until, std::vector<util::mute>& mutes) {
+    // The type and active literals let the mod_records_active_mutes partial index be used. With a lower bound,
+    // the mutes_end_time index is searched instead, so only the mutes in range are read.
+    std::string condition = "type='Mute' AND active='true' AND ";
+    if (since == 0) {
+        condition += std::format("(m.end_time IS NULL OR m.end_time < {})", until);
+    } else {
+        condition += std::format("m.end_time >= {} AND m.end_time < {}", since, until);
+    }
+    std::vector<mod_record> records;
+    if (!query_mod_records(db, "main", condition, records)) {
+        return false;
+    }
+    const time_t now = time(nullptr);
+    for (const mod_record& record : records) {
+        util::mute mute;
+        mute.id = record.extra_data;
+        mute.user = record.user;
+        mute.guild = record.guild;
+        // A mute without a mutes table row can't be timed, so remove it right away
+        if (record.mute_end == 0) {
+            mute.start_time = now;
+            mute.end_time = now;
+        } else {
+            mute.start_time = record.mute_start;
+            mute.end_time = record.mute_end;
+        }
+        mutes.push_back(mute);
+    }
+    return true;
+}
+
+bool db::get_reminders(sqlite3* db, const time_t until, std::vector<util::reminder>& reminders) {
+    // Sent reminders are deleted, so every row in range is still pending
+    return query(db, std::format("SELECT id, start_time, end_time, user, text, guild FROM reminders WHERE end_time < {};", until), reminders);
+}
+
+bool db::get_state(sqlite3* db, const dpp::snowflake guild, std::map<std::string, int64_t>& state) {
+    std::vector<std::tuple<std::string, int64_t>> rows;
+    if (!query(db, std::format("SELECT key, value FROM bot_state WHERE guild='{}';", guild.str()), rows)) {
+        return false;
+    }
+    for (auto& [key, value] : rows) {
+        state[std::move(key)] = value;
+    }
+    return true;
+}
+
+bool db::set_state(sqlite3* db, const dpp::snowflake guild, const std::map<std::string, int64_t>& state) {
+    if (state.empty()) {
+        return true;
+    }
+    // Keys are bound rather than quoted into the statement, so they're stored exactly as given
+    std::string values;
+    std::vector<std::string_view> keys;
+    for (const auto& [key, value] : state) {
+        values += std::format("{}('{}', ?, {})", values.empty() ? "" : ", ", guild.str(), value);
+        keys.push_back(key);
+    }
+    return execute(db, std::format("INSERT OR REPLACE INTO bot_state(guild, key, value) VALUES {};", values), keys);
+}
+
+bool db::delete_state(sqlite3* db, const dpp::snowflake guild, const std::vector<std::string>& keys) {
+    if (keys.empty()) {
+        return true;
+    }
+    std::string placeholders;
+    for (size_t i = 0; i < keys.size(); i++) {
+        placeholders += i == 0 ? "?" : ", ?";
+    }
+    return execute(db, std::format("DELETE FROM bot_state WHERE guild='{}' AND key IN ({});", guild.str(), placeholders), {keys.begin(), keys.end()});
+}
+
+bool db::init_schema(sqlite3* db, const dpp::snowflake main_guild) {
+    // The tables this needs to change, and whether each one has a guild column yet
+    std::vector<std::tuple<std::string, uint64_t>> tables;
+    if (!query(db, "SELECT t.name, (SELECT count(*) FROM pragma_table_info(t.name) WHERE name = 'guild') FROM sqlite_schema t "
+                   "WHERE t.type = 'table' AND t.name IN ('mod_records', 'mutes', 'reminders', 'mod_stats', 'bot_state');", tables)) {
+        return false;
+    }
+    std::map<std::string, bool> partitioned;
+    for (const auto& [name, guild_columns] : tables) {
+        partitioned[name] = guild_columns != 0;
+    }
+    const std::string guild = main_guild.str();
+
+    // Everything from before the DB was partitioned by server happened in the main server
+    std::string statements;
+    for (const std::string_view table : {"mod_records", "mutes", "reminders"}) {
+        if (!partitioned[std::string(table)]) {
+            statements += std::format("ALTER TABLE {0} ADD COLUMN guild TEXT; UPDATE {0} SET guild = '{1}';", table, guild);
+        }
+    }
+    statements += "CREATE INDEX IF NOT EXISTS mod_records_user ON mod_records(user, id);"
+                  "CREATE INDEX IF NOT EXISTS mod_records_active_mutes ON mod_records(extra_data) WHERE type = 'Mute' AND active = 'true';"
+                  "CREATE INDEX IF NOT EXISTS mod_records_active_warnings ON mod_records(id) WHERE type = 'Warning' AND active = 'true';"
+                  "CREATE INDEX IF NOT EXISTS mutes_end_time ON mutes(end_time);"
+                  "CREATE INDEX IF NOT EXISTS reminders_end_time ON reminders(end_time);";
+
+    // Primary keys can't be changed in place, so the tables that need guild in theirs are rebuilt
+    const bool stats_exist = partitioned.contains("mod_stats");
+    if (stats_exist && !partitioned["mod_stats"]) {
+        statements += "ALTER TABLE mod_stats RENAME TO mod_stats_old;";
+    }
+    if (!stats_exist || !partitioned["mod_stats"]) {
+        statements += "CREATE TABLE mod_stats(day INTEGER, guild TEXT, moderator TEXT, type TEXT, count INTEGER, "
+                      "PRIMARY KEY (day, guild, moderator, type)) WITHOUT ROWID;";
+    }
+    if (!stats_exist) {
+        // Fill the rollup from the records already in main, the same way add_mod_record counts them
+        statements += "INSERT INTO mod_stats SELECT ((CAST(id AS INTEGER) >> 22) + 1420070400000) / 86400000 AS day, guild, moderator, type, count(*) "
+                      "FROM mod_records GROUP BY day, guild, moderator, type;";
+    } else if (!partitioned["mod_stats"]) {
+        statements += std::format("INSERT INTO mod_stats SELECT day, '{}', moderator, type, count FROM mod_stats_old; DROP TABLE mod_stats_old;", guild);
+    }
+
+    const bool state_exists = partitioned.contains("bot_state");
+    if (state_exists && !partitioned["bot_state"]) {
+        statements += "ALTER TABLE bot_state RENAME TO bot_state_old;";
+    }
+    statements += "CREATE TABLE IF NOT EXISTS bot_state(guild TEXT, key TEXT, value INTEGER, PRIMARY KEY (guild, key)) WITHOUT ROWID;";
+    if (state_exists && !partitioned["bot_state"]) {
+        // Global command hashes aren't for any server
+        statements += std::format("INSERT INTO bot_state SELECT CASE WHEN key GLOB 'commands:global:*' THEN '0' ELSE '{}' END, key, value "
+                                  "FROM bot_state_old; DROP TABLE bot_state_old;", guild);
+    }
+
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    const bool success = exec_transaction(db, statements);
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
+    if (!success) {
+        return false;
+    }
+    if (!stats_exist) {
+        util::log("INFO", "Created moderation statistics rollup");
+    }
+    if (!partitioned["mod_records"]) {
+        util::log("INFO", "Partitioned database by server");
+    }
+    return init_search(db);
+}
+
+bool db::init_search(sqlite3* db) {
+    // Find out which indexes need filling before creating them
+    std::vector<std::tuple<std::string>> existing;
+    if (!query(db, "SELECT name FROM sqlite_schema WHERE name IN ('mod_records_fts', 'ban_appeals_fts', 'staff_applications_fts');", existing)) {
+        return false;
+    }
+    const auto missing = [&existing](const std::string_view table) {
+        return std::ranges::none_of(existing, [table](const std::tuple<std::string>& row){return std::get<0>(row) == table;});
+    };
+    const bool index_mod_records = missing("mod_records_fts");
+    const bool index_ban_appeals = missing("ban_appeals_fts");
+    const bool index_staff_applications = missing("staff_applications_fts");
+    if (!index_mod_records && !index_ban_appeals && !index_staff_applications) {
+        return true;
+    }
+
+    // Same schema as create_database.sh
+    std::string statements = "BEGIN;"
+    "CREATE VIRTUAL TABLE IF NOT EXISTS mod_records_fts USING fts5(reason, tokenize='porter unicode61');"
+    "CREATE TRIGGER IF NOT EXISTS mod_records_fts_insert AFTER INSERT ON mod_records BEGIN "
+        "INSERT INTO mod_records_fts(rowid, reason) VALUES (CAST(new.id AS INTEGER), new.reason); END;"
+    "CREATE TRIGGER IF NOT EXISTS mod_records_fts_delete AFTER DELETE ON mod_records BEGIN "
+        "DELETE FROM mod_records_fts WHERE rowid = CAST(old.id AS INTEGER); END;"
+    "CREATE TRIGGER IF NOT EXISTS mod_records_fts_update AFTER UPDATE OF id, reason ON mod_records BEGIN "
+        "DELETE FROM mod_records_fts WHERE rowid = CAST(old.id AS INTEGER);"
+        "INSERT INTO mod_records_fts(rowid, reason) VALUES (CAST(new.id AS INTEGER), new.reason); END;"
+    "CREATE VIRTUAL TABLE IF NOT EXISTS ban_appeals_fts USING fts5(reason, appeal, content='ban_appeals', tokenize='porter unicode61');"
+    "CREATE TRIGGER IF NOT EXISTS ban_appeals_fts_insert AFTER INSERT ON ban_appeals BEGIN "
+        "INSERT INTO ban_appeals_fts(rowid, reason, appeal) VALUES (new.rowid, new.reason, new.appeal); END;"
+    "CREATE TRIGGER IF NOT EXISTS ban_appeals_fts_delete AFTER DELETE ON ban_appeals BEGIN "
+        "INSERT INTO ban_appeals_fts(ban_appeals_fts, rowid, reason, appeal) VALUES ('delete', old.rowid, old.reason, old.appeal); END;"
+    "CREATE TRIGGER IF NOT EXISTS ban_appeals_fts_update AFTER UPDATE OF reason, appeal ON ban_appeals BEGIN "
+        "INSERT INTO ban_appeals_fts(ban_appeals_fts, rowid, reason, appeal) VALUES ('delete', old.rowid, old.reason, old.appeal);"
+        "INSERT INTO ban_appeals_fts(rowid, reason, appeal) VALUES (new.rowid, new.reason, new.appeal); END;"
+    "CREATE VIRTUAL TABLE IF NOT EXISTS staff_applications_fts USING fts5(q1, q2, q3, q4, q5, q6, q7, q8, q9, q10, content='staff_applications', tokenize='porter unicode61');"
+    "CREATE TRIGGER IF NOT EXISTS staff_applications_fts_insert AFTER INSERT ON staff_applications BEGIN "
+        "INSERT INTO staff_applications_fts(rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10) "
+        "VALUES (new.rowid, new.q1, new.q2, new.q3, new.q4, new.q5, new.q6, new.q7, new.q8, new.q9, new.q10); END;"
+    "CREATE TRIGGER IF NOT EXISTS staff_applications_fts_delete AFTER DELETE ON staff_applications BEGIN "
+        "INSERT INTO staff_applications_fts(staff_applications_fts, rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10) "
+        "VALUES ('delete', old.rowid, old.q1, old.q2, old.q3, old.q4, old.q5, old.q6, old.q7, old.q8, old.q9, old.q10); END;"
+    "CREATE TRIGGER IF NOT EXISTS staff_applications_fts_update AFTER UPDATE OF q1, q2, q3, q4, q5, q6, q7, q8, q9, q10 ON staff_applications BEGIN "
+        "INSERT INTO staff_applications_fts(staff_applications_fts, rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10) "
+        "VALUES ('delete', old.rowid, old.q1, old.q2, old.q3, old.q4, old.q5, old.q6, old.q7, old.q8, old.q9, old.q10);"
+        "INSERT INTO staff_applications_fts(rowid, q1, q2, q3, q4, q5, q6, q7, q8, q9, q10) "
+        "VALUES (new.rowid, new.q1, new.q2, new.q3, new.q4, new.q5, new.q6, new.q7, new.q8, new.q9, new.q10); END;";
+    // Index rows that were added before the index existed
+    if (index_mod_records) {
+        statements += "INSERT INTO mod_records_fts(rowid, reason) SELECT CAST(id AS INTEGER), reason FROM mod_records;";
+    }
+    if (index_ban_appeals) {
+        statements += "INSERT INTO ban_appeals_fts(ban_appeals_fts) VALUES ('rebuild');";
+    }
+    if (index_staff_applications) {
+        statements += "INSERT INTO staff_applications_fts(staff_applications_fts) VALUES ('rebuild');";
+    }
+    statements += "COMMIT;";
+    char* error_message;
+    sqlite3_exec(db, statements.c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return false;
+    }
+    util::log("INFO", "Created full-text search indexes");
+    return true;
+}
+
+bool db::search_records(sqlite3* db, const dpp::snowflake guild, const search_source source, const std::string_view query, const unsigned int limit,
+                        std::vector<search_result>& results) {
+    std::string sql;
+    std::string_view table;
+    std::string condition;
+    switch (source) {
+        case MOD_RECORDS:
+            table = "mod_records_fts";
+            // mod_records_fts rowids are the record IDs
+            sql = "SELECT mod_records.id, user, type, snippet(mod_records_fts, 0, '**', '**', '...', 24) FROM mod_records_fts "
+                  "JOIN mod_records ON mod_records.id = CAST(mod_records_fts.rowid AS TEXT) ";
+            condition = std::format(" AND mod_records.guild = '{}'", guild.str());
+            break;
+        case BAN_APPEALS:
+            table = "ban_appeals_fts";
+            sql = "SELECT ban_appeals.rowid, id, status, snippet(ban_appeals_fts, -1, '**', '**', '...', 24) FROM ban_appeals_fts "
+                  "JOIN ban_appeals ON ban_appeals.rowid = ban_appeals_fts.rowid ";
+            break;
+        case STAFF_APPLICATIONS:
+            table = "staff_applications_fts";
+            sql = "SELECT staff_applications.rowid, id, type, snippet(staff_applications_fts, -1, '**', '**', '...', 24) FROM staff_applications_fts "
+                  "JOIN staff_applications ON staff_applications.rowid = staff_applications_fts.rowid ";
+            break;
+    }
+    // FTS5's rank column orders by bm25 relevance. The query is bound so FTS5 gets it exactly as the user typed it.
+    sql += std::format("WHERE {} MATCH ?{} ORDER BY rank LIMIT {};", table, condition, limit);
+
+    return db::query(db, sql, results, {query});
+}
+
+static std::mutex profile_mutex; /**< Guards the profiling state below */
+static std::unordered_map<std::string, db::query_stats> query_totals; /**< Totals keyed by normalized statement */
+static std::unordered_map<sqlite3_stmt*, uint64_t> pending_rows; /**< Rows returned so far by statements still running */
+static std::chrono::nanoseconds slow_query_threshold; /**< Statements taking at least this long are logged */
+
+/**
+ * Replace the string and numeric literals in a statement with "?", so that runs with different values are grouped together
+ * @param sql Statement to normalize
+ * @return Normalized statement
+ */
+static std::string normalize_sql(const std::string_view sql) {
+    std::string normalized;
+    normalized.reserve(sql.size());
+    for (size_t i = 0; i < sql.size(); i++) {
+        if (sql[i] == '\'') {
+            // Skip to the closing quote, treating '' as an escaped quote
+            while (++i < sql.size() && !(sql[i] == '\'' && (i + 1 == sql.size() || sql[i + 1] != '\''))) {
+                if (sql[i] == '\'') {
+                    i++;
+                }
+            }
+            normalized += '?';
+        } else if (std::isdigit(static_cast<unsigned char>(sql[i])) &&
+                   (normalized.empty() || !(std::isalnum(static_cast<unsigned char>(normalized.back())) || normalized.back() == '_'))) {
+            while (i + 1 < sql.size() && (std::isalnum(static_cast<unsigned char>(sql[i + 1])) || sql[i + 1] == '.')) {
+                i++;
+            }
+            normalized += '?';
+        } else {
+            normalized += sql[i];
+        }
+    }
+    return normalized;
+}
+
+/**
+ * SQLite trace callback that counts rows as they're returned and records timing when a statement finishes
+ * @param type SQLITE_TRACE_ROW or SQLITE_TRACE_PROFILE
+ * @param context Unused
+ * @param statement The statement being traced
+ * @param elapsed For SQLITE_TRACE_PROFILE, pointer to the statement's run time in nanoseconds
+ * @return Always 0
+ */
+static int trace_statement(const unsigned int type, void* context, void* statement, void* elapsed) {
+    auto stmt = static_cast<sqlite3_stmt*>(statement);
+    uint64_t rows = 0;
+    std::chrono::nanoseconds ns;
+    {
+        std::lock_guard lock(profile_mutex);
+        if (type == SQLITE_TRACE_ROW) {
+            pending_rows[stmt]++;
+            return 0;
+        }
+        if (auto it = pending_rows.find(stmt); it != pending_rows.end()) {
+            rows = it->second;
+            pending_rows.erase(it);
+        }
+        ns = std::chrono::nanoseconds(*static_cast<sqlite3_int64*>(elapsed));
+        db::query_stats& stats = query_totals[normalize_sql(sqlite3_sql(stmt))];
+        stats.count++;
+        stats.rows += rows;
+        stats.total_ns += ns.count();
+        stats.max_ns = std::max<uint64_t>(stats.max_ns, ns.count());
+    }
+    if (ns >= slow_query_threshold) {
+        // The expanded statement includes the values of any bound parameters
+        char* expanded = sqlite3_expanded_sql(stmt);
+        util::log("SLOW QUERY", std::format("{:.1f} ms, {} rows: {}", ns.count() / 1e6, rows, expanded != nullptr ? expanded : sqlite3_sql(stmt)));
+        sqlite3_free(expanded);
+    }
+    return 0;
+}
+
+void db::enable_profiling(sqlite3* db, const std::chrono::milliseconds slow_threshold) {
+    slow_query_threshold = slow_threshold;
+    sqlite3_trace_v2(db, SQLITE_TRACE_ROW | SQLITE_TRACE_PROFILE, trace_statement, nullptr);
+}
+
+std::vector<std::pair<std::string, db::query_stats>> db::get_query_stats() {
+    std::vector<std::pair<std::string, query_stats>> stats;
+    {
+        std::lock_guard lock(profile_mutex);
+        stats.assign(query_totals.begin(), query_totals.end());
+    }
+    std::ranges::sort(stats, std::ranges::greater(), [](const auto& entry){return entry.second.total_ns;});
+    return stats;
+}
+
+/**
+ * Sleep for a duration unless a stop is requested first
+ * @param stop Token to wake up early on
+ * @param duration Time to sleep for
+ * @return false if a stop was requested
+ */
+static bool interruptible_sleep(const std::stop_token& stop, const std::chrono::milliseconds duration) {
+    std::mutex mutex;
+    std::unique_lock lock(mutex);
+    std::condition_variable_any().wait_for(lock, stop, duration, []{return false;});
+    return !stop.stop_requested();
+}
+
+bool db::backup(sqlite3* db, const std::filesystem::path& path, const int pages_per_step, const std::chrono::milliseconds step_delay, const std::stop_token& stop) {
+    // Write to a temporary file so a partial backup is never mistaken for a complete one
+    std::filesystem::path temp_path = path;
+    temp_path += ".part";
+    std::error_code err;
+    sqlite3* dest;
+    if (sqlite3_open(temp_path.string().c_str(), &dest) != SQLITE_OK) {
+        util::log("SQL ERROR", std::format("Failed to open backup file \"{}\": {}", temp_path.string(), sqlite3_errmsg(dest)));
+        sqlite3_close(dest);
+        return false;
+    }
+    sqlite3_backup* backup = sqlite3_backup_init(dest, "main", db, "main");
+    if (backup == nullptr) {
+        util::log("SQL ERROR", std::format("Failed to start backup: {}", sqlite3_errmsg(dest)));
+        sqlite3_close(dest);
+        std::filesystem::remove(temp_path, err);
+        return false;
+    }
+    // Since the backup reads through the bot's own connection, its writes are copied into the backup as
+    // they happen instead of restarting it, so the only contention is the lock held during each step.
+    int status;
+    do {
+        status = sqlite3_backup_step(backup, pages_per_step);
+    } while ((status == SQLITE_OK || status == SQLITE_BUSY || status == SQLITE_LOCKED) && interruptible_sleep(stop, step_delay));
+    sqlite3_backup_finish(backup);
+    sqlite3_close(dest);
+    if (status != SQLITE_DONE) {
+        if (!stop.stop_requested()) {
+            util::log("SQL ERROR", std::format("Backup to \"{}\" failed: {}", path.string(), sqlite3_errstr(status)));
+        }
+        std::filesystem::remove(temp_path, err);
+        return false;
+    }
+    std::filesystem::rename(temp_path, path, err);
+    if (err) {
+        util::log("ERROR", std::format("Failed to move backup into place at \"{}\": {}", path.string(), err.message()));
+        std::filesystem::remove(temp_path, err);
+        return false;
+    }
+    return true;
+}
+
+std::jthread db::start_backups(sqlite3* db, const nlohmann::json& config, const std::filesystem::path& db_file, const std::filesystem::path& data_path) {
+    if (!config.contains("backup")) {
+        return {};
+    }
+    const std::filesystem::path dir = data_path / config["backup"]["directory"].get<std::string>();
+    try {
+        std::filesystem::create_directories(dir);
+    } catch (const std::filesystem::filesystem_error& e) {
+        util::log("ERROR", std::format("Failed to create backup directory, backups disabled: {}", e.what()));
+        return {};
+    }
+    const std::chrono::hours interval(config["backup"]["interval_hours"].get<unsigned int>());
+    const unsigned int retention = config["backup"]["retention"];
+    const int pages_per_step = config["backup"]["pages_per_step"];
+    const std::chrono::milliseconds step_delay(config["backup"]["step_delay_ms"].get<unsigned int>());
+
+    return std::jthread([=](const std::stop_token& stop) {
+        const std::string prefix = db_file.stem().string() + '_';
+        do {
+            // Name backups by UTC time so they sort oldest first; localtime's shared buffer isn't safe off the main thread
+            const std::string timestamp = std::format("{:%Y%m%d-%H%M%S}", std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now()));
+            const std::filesystem::path path = dir / (prefix + timestamp + db_file.extension().string());
+            if (!backup(db, path, pages_per_step, step_delay, stop)) {
+                continue;
+            }
+            util::log("INFO", std::format("Backed up database to \"{}\"", path.string()));
+
+            // Delete the oldest backups beyond the retention count
+            std::vector<std::filesystem::path> backups;
+            try {
+                for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator(dir)) {
+                    const std::string filename = entry.path().filename().string();
+                    if (entry.is_regular_file() && filename.starts_with(prefix) && entry.path().extension() == db_file.extension()) {
+                        backups.push_back(entry.path());
+                    }
+                }
+                std::ranges::sort(backups);
+                for (size_t i = 0; i + retention < backups.size(); i++) {
+                    std::filesystem::remove(backups[i]);
+                }
+            } catch (const std::filesystem::filesystem_error& e) {
+                util::log("ERROR", std::format("Failed to delete old backups: {}", e.what()));
+            }
+        } while (interruptible_sleep(stop, interval));
+    });
+}
+
+bool db::attach_archive(sqlite3* db, const std::filesystem::path& path, const dpp::snowflake main_guild) {
+    // The path is bound so it's used exactly as given
+    const std::string path_string = path.string();
+    if (!execute(db, "ATTACH DATABASE ? AS archive;", {path_string})) {
+        return false;
+    }
+    // An archive from before the DB was partitioned by server needs the guild column added, the same way init_schema does it
+    std::vector<std::tuple<uint64_t>> old_archive;
+    if (!query(db, "SELECT count(*) FROM archive.sqlite_schema WHERE name = 'mod_records' "
+                   "AND NOT EXISTS (SELECT 1 FROM pragma_table_info('mod_records', 'archive') WHERE name = 'guild');", old_archive)) {
+        return false;
+    }
+    std::string migrate;
+    if (!old_archive.empty() && std::get<0>(old_archive[0]) != 0) {
+        migrate = std::format("ALTER TABLE archive.mutes ADD COLUMN guild TEXT; UPDATE archive.mutes SET guild = '{0}';"
+                              "ALTER TABLE archive.mod_records ADD COLUMN guild TEXT; UPDATE archive.mod_records SET guild = '{0}';", main_guild.str());
+    }
+    char* error_message;
+    sqlite3_exec(db, (migrate + "CREATE TABLE IF NOT EXISTS archive.mutes(id INTEGER PRIMARY KEY ASC, start_time INTEGER, end_time INTEGER, guild TEXT);"
+    "CREATE TABLE IF NOT EXISTS archive.mod_records(id TEXT PRIMARY KEY, type TEXT, moderator TEXT, user TEXT, reason TEXT, active TEXT, extra_data INTEGER, guild TEXT) WITHOUT ROWID;"
+    "CREATE INDEX IF NOT EXISTS archive.mod_records_user ON mod_records(user, id);"
+    "CREATE TABLE IF NOT EXISTS archive.staff_applications(id TEXT, time INTEGER, type TEXT, status TEXT, q1 TEXT, q2 TEXT, q3 TEXT, q4 TEXT, q5 TEXT, q6 TEXT, q7 TEXT, q8 TEXT, q9 TEXT, q10 TEXT);"
+    "CREATE TABLE IF NOT EXISTS archive.ban_appeals(id TEXT, email TEXT, time INTEGER, status TEXT, reason TEXT, appeal TEXT);"
+    "CREATE TEMP TABLE IF NOT EXISTS archive_batch(id PRIMARY KEY);").c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return false;
+    }
+
+    // Without auto-vacuum, archived rows leave free pages behind that the file never shrinks back from
+    std::vector<std::tuple<int>> auto_vacuum;
+    if (query(db, "PRAGMA main.auto_vacuum;", auto_vacuum) && !auto_vacuum.empty() && std::get<0>(auto_vacuum[0]) != 2) {
+        util::log("INFO", "Switching database to incremental auto-vacuum, this may take a while");
+        // VACUUM can renumber rowids, so the external content full-text indexes are rebuilt after it
+        sqlite3_exec(db, "PRAGMA main.auto_vacuum = INCREMENTAL; VACUUM main;"
+                         "INSERT INTO ban_appeals_fts(ban_appeals_fts) VALUES ('rebuild');"
+                         "INSERT INTO staff_applications_fts(staff_applications_fts) VALUES ('rebuild');",
+                     nullptr, nullptr, &error_message);
+        if (error_message != nullptr) {
+            util::log("SQL ERROR", error_message);
+            sqlite3_free(error_message);
+        }
+    }
+    return true;
+}
+
+/**
+ * Move one batch of rows into the archive in a single transaction
+ * @param db SQLite DB pointer with the archive attached
+ * @param select_batch Statement filling temp.archive_batch with the keys of the rows to move
+ * @param move Statements copying the rows in temp.archive_batch to the archive and deleting them from main, deleting last
+ * @return Number of rows moved, or -1 on failure
+ */
+static int archive_batch(sqlite3* db, const std::string_view select_batch, const std::string_view move) {
+    char* error_message;
+    // Other threads share this connection, so hold it to keep their statements out of the transaction
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    sqlite3_exec(db, std::format("BEGIN; DELETE FROM temp.archive_batch; {} {} COMMIT;", select_batch, move).c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        sqlite3_mutex_leave(sqlite3_db_mutex(db));
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
+        return -1;
+    }
+    // COMMIT doesn't count as a change, so this is the final DELETE from main
+    const int moved = sqlite3_changes(db);
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
+    return moved;
+}
+
+std::jthread db::start_archiving(sqlite3* db, const nlohmann::json& config, const std::filesystem::path& data_path) {
+    if (!config.contains("archive")) {
+        return {};
+    }
+    if (!attach_archive(db, data_path / config["archive"]["file"].get<std::string>(), config["guild_id"].get<uint64_t>())) {
+        util::log("ERROR", "Failed to attach archive database, archiving disabled");
+        return {};
+    }
+    const std::chrono::hours interval(config["archive"]["interval_hours"].get<unsigned int>());
+    const unsigned int max_age_days = config["archive"]["max_age_days"];
+    const unsigned int batch_size = config["archive"]["batch_size"];
+    const std::chrono::milliseconds batch_delay(config["archive"]["batch_delay_ms"].get<unsigned int>());
+
+    return std::jthread([=](const std::stop_token& stop) {
+        do {
+            const time_t cutoff = time(nullptr) - max_age_days * 86400LL;
+            // Snowflakes store their creation time in milliseconds since the Discord epoch in the bits above 22
+            const int64_t cutoff_snowflake = (cutoff * 1000LL - 1420070400000LL) << 22;
+            // Timeouts and kicks are never marked inactive, but Discord ends timeouts within 28 days
+            // and a kick is over as soon as it happens
+            const int64_t timeout_cutoff_snowflake = ((time(nullptr) - 28 * 86400LL) * 1000LL - 1420070400000LL) << 22;
+            const std::array<std::pair<std::string, std::string>, 3> jobs = {{
+                {
+                    std::format("INSERT INTO temp.archive_batch SELECT id FROM main.mod_records "
+                                "WHERE (active = 'false' OR type = 'Kick' OR (type = 'Timeout' AND CAST(id AS INTEGER) < {})) "
+                                "AND CAST(id AS INTEGER) < {} LIMIT {};",
+                                timeout_cutoff_snowflake, cutoff_snowflake, batch_size),
+                    "INSERT INTO archive.mutes SELECT * FROM main.mutes WHERE id IN "
+                        "(SELECT extra_data FROM main.mod_records WHERE type IN ('Mute', 'Timeout') AND id IN temp.archive_batch);"
+                    "DELETE FROM main.mutes WHERE id IN (SELECT extra_data FROM main.mod_records WHERE type IN ('Mute', 'Timeout') AND id IN temp.archive_batch);"
+                    "INSERT INTO archive.mod_records SELECT * FROM main.mod_records WHERE id IN temp.archive_batch;"
+                    "DELETE FROM main.mod_records WHERE id IN temp.archive_batch;"
+                },
+                {
+                    std::format("INSERT INTO temp.archive_batch SELECT rowid FROM main.ban_appeals "
+                                "WHERE status != 'pending' AND time < {} LIMIT {};", cutoff, batch_size),
+                    "INSERT INTO archive.ban_appeals SELECT * FROM main.ban_appeals WHERE rowid IN temp.archive_batch;"
+                    "DELETE FROM main.ban_appeals WHERE rowid IN temp.archive_batch;"
+                },
+                {
+                    std::format("INSERT INTO temp.archive_batch SELECT rowid FROM main.staff_applications "
+                                "WHERE status != 'pending' AND time < {} LIMIT {};", cutoff, batch_size),
+                    "INSERT INTO archive.staff_applications SELECT * FROM main.staff_applications WHERE rowid IN temp.archive_batch;"
+                    "DELETE FROM main.staff_applications WHERE rowid IN temp.archive_batch;"
+                }
+            }};
+            // Move rows in small batches, pausing between them so handlers aren't kept waiting on the DB
+            int total = 0;
+            for (const auto& [select_batch, move] : jobs) {
+                int moved;
+                do {
+                    moved = archive_batch(db, select_batch, move);
+                    total += std::max(moved, 0);
+                } while (moved == static_cast<int>(batch_size) && interruptible_sleep(stop, batch_delay));
+            }
+            if (total == 0) {
+                continue;
+            }
+            util::log("INFO", std::format("Archived {} old records", total));
+            // Archived records are no longer in main, so cached copies of them are out of date
+            MOD_RECORD_CACHE.clear();
+
+            // Return the freed pages to the filesystem a batch at a time
+            std::vector<std::tuple<int>> free_pages;
+            do {
+                free_pages.clear();
+                sqlite3_exec(db, std::format("PRAGMA main.incremental_vacuum({});", batch_size).c_str(), nullptr, nullptr, nullptr);
+            } while (query(db, "PRAGMA main.freelist_count;", free_pages) && !free_pages.empty() && std::get<0>(free_pages[0]) > 0 &&
+                     interruptible_sleep(stop, batch_delay));
+        } while (interruptible_sleep(stop, interval));
+    });
+}
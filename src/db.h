@@ -0,0 +1,554 @@
+/* db: Shared database queries
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include "util.h"
+#include <filesystem>
+#include <list>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <tuple>
+
+namespace db {
+    /**
+     * Reads one result column into a value of type T, leaving the value untouched if the column is NULL.
+     * Numbers are read with SQLite's native integer accessor, even from TEXT columns holding digits like snowflakes.
+     * @tparam T Type to read into
+     */
+    template<typename T>
+    struct column_reader;
+
+    template<std::integral T>
+    struct column_reader<T> {
+        static void read(sqlite3_stmt* stmt, const int column, T& value) {
+            if (sqlite3_column_type(stmt, column) != SQLITE_NULL) {
+                value = static_cast<T>(sqlite3_column_int64(stmt, column));
+            }
+        }
+    };
+
+    template<>
+    struct column_reader<bool> {
+        static void read(sqlite3_stmt* stmt, const int column, bool& value) {
+            switch (sqlite3_column_type(stmt, column)) {
+                case SQLITE_NULL:
+                    break;
+                case SQLITE_TEXT:
+                    // Booleans are stored as 'true' and 'false'
+                    value = strcmp(reinterpret_cast<const char*>(sqlite3_column_text(stmt, column)), "false") != 0;
+                    break;
+                default:
+                    value = sqlite3_column_int64(stmt, column) != 0;
+            }
+        }
+    };
+
+    template<>
+    struct column_reader<dpp::snowflake> {
+        static void read(sqlite3_stmt* stmt, const int column, dpp::snowflake& value) {
+            if (sqlite3_column_type(stmt, column) != SQLITE_NULL) {
+                value = static_cast<uint64_t>(sqlite3_column_int64(stmt, column));
+            }
+        }
+    };
+
+    template<>
+    struct column_reader<std::string> {
+        static void read(sqlite3_stmt* stmt, const int column, std::string& value) {
+            if (sqlite3_column_type(stmt, column) != SQLITE_NULL) {
+                // Get the text before its length, as the SQLite docs recommend
+                const auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, column));
+                value.assign(text, sqlite3_column_bytes(stmt, column));
+            }
+        }
+    };
+
+    template<typename T>
+    struct column_reader<std::optional<T>> {
+        static void read(sqlite3_stmt* stmt, const int column, std::optional<T>& value) {
+            if (sqlite3_column_type(stmt, column) == SQLITE_NULL) {
+                value.reset();
+            } else {
+                column_reader<T>::read(stmt, column, value.emplace());
+            }
+        }
+    };
+
+    /**
+     * How to read a result row into a T. Specializations provide a static read(sqlite3_stmt*, T&) function,
+     * usually by inheriting from member_mapping. Tuples are read one column per element.
+     * @tparam T Type to read rows into
+     */
+    template<typename T>
+    struct row_mapping;
+
+    /**
+     * Row mapping that reads each result column, in order, into the corresponding struct member
+     * @tparam Members Pointers to the members to read into
+     */
+    template<auto... Members>
+    struct member_mapping {
+        template<typename T>
+        static void read(sqlite3_stmt* stmt, T& row) {
+            int column = 0;
+            (column_reader<std::remove_cvref_t<decltype(row.*Members)>>::read(stmt, column++, row.*Members), ...);
+        }
+    };
+
+    template<typename... Ts>
+    struct row_mapping<std::tuple<Ts...>> {
+        static void read(sqlite3_stmt* stmt, std::tuple<Ts...>& row) {
+            [&]<size_t... I>(std::index_sequence<I...>) {
+                (column_reader<Ts>::read(stmt, I, std::get<I>(row)), ...);
+            }(std::index_sequence_for<Ts...>());
+        }
+    };
+
+    template<>
+    struct row_mapping<util::reminder> : member_mapping<&util::reminder::id, &util::reminder::start_time, &util::reminder::end_time,
+                                                        &util::reminder::user, &util::reminder::text, &util::reminder::guild> {};
+
+    template<>
+    struct row_mapping<util::mute> : member_mapping<&util::mute::id, &util::mute::user, &util::mute::start_time, &util::mute::end_time, &util::mute::guild> {};
+
+    /**
+     * Run a single SQL statement and read every row it returns
+     * @tparam T Type to read each row into, which must have a row_mapping
+     * @param db SQLite DB pointer to query
+     * @param sql Statement to run
+     * @param rows Vector to append the rows to
+     * @param params Text bound to the statement's ? parameters in order, so it's used as-is without any escaping
+     * @return true if the statement ran to completion
+     */
+    template<typename T>
+    bool query(sqlite3* db, const std::string_view sql, std::vector<T>& rows, const std::vector<std::string_view>& params = {}) {
+        // Hold the connection for the whole query like sqlite3_exec does, so the error message is this query's
+        sqlite3_mutex* mutex = sqlite3_db_mutex(db);
+        sqlite3_mutex_enter(mutex);
+        sqlite3_stmt* stmt;
+        int status = sqlite3_prepare_v2(db, sql.data(), static_cast<int>(sql.size()), &stmt, nullptr);
+        for (int i = 0; status == SQLITE_OK && i < static_cast<int>(params.size()); i++) {
+            status = sqlite3_bind_text(stmt, i + 1, params[i].data(), static_cast<int>(params[i].size()), SQLITE_STATIC);
+        }
+        if (status == SQLITE_OK) {
+            while ((status = sqlite3_step(stmt)) == SQLITE_ROW) {
+                row_mapping<T>::read(stmt, rows.emplace_back());
+            }
+        }
+        if (status != SQLITE_DONE) {
+            util::log("SQL ERROR", sqlite3_errmsg(db));
+        }
+        sqlite3_finalize(stmt);
+        sqlite3_mutex_leave(mutex);
+        return status == SQLITE_DONE;
+    }
+
+    /**
+     * Run a single SQL statement that doesn't return rows
+     * @param db SQLite DB pointer to run it on
+     * @param sql Statement to run
+     * @param params Text bound to the statement's ? parameters in order
+     * @return true if the statement ran to completion
+     */
+    inline bool execute(sqlite3* db, const std::string_view sql, const std::vector<std::string_view>& params = {}) {
+        std::vector<std::tuple<>> rows;
+        return query(db, sql, rows, params);
+    }
+
+    /**
+     * A row of mod_records, with the mute times joined in for Mute records
+     */
+    struct mod_record {
+        dpp::snowflake id; /**< ID of the log message for this action */
+        dpp::snowflake guild; /**< ID of the server the action was taken in */
+        std::string type = "Unknown"; /**< Type of action (Warning, Mute, Timeout, Kick, Ban) */
+        dpp::snowflake moderator; /**< ID of moderator who took the action */
+        dpp::snowflake user; /**< ID of user the action was taken against */
+        std::string reason = "No reason provided."; /**< Reason given for the action */
+        bool active = false; /**< Whether the action is still in effect */
+        int64_t extra_data = 0; /**< Ban message deletion seconds or mutes table row ID */
+        time_t mute_start = 0; /**< Time the mute started, 0 if not a mute or timeout */
+        time_t mute_end = 0; /**< Time the mute expires, 0 if not a mute or timeout */
+    };
+
+    template<>
+    struct row_mapping<mod_record> : member_mapping<&mod_record::id, &mod_record::guild, &mod_record::type, &mod_record::moderator, &mod_record::user,
+                                                    &mod_record::reason, &mod_record::active, &mod_record::extra_data,
+                                                    &mod_record::mute_start, &mod_record::mute_end> {};
+
+    /**
+     * Running totals for every execution of one statement
+     */
+    struct query_stats {
+        uint64_t count = 0; /**< Number of times the statement was run */
+        uint64_t rows = 0; /**< Total number of rows it returned */
+        uint64_t total_ns = 0; /**< Total time spent running it, in nanoseconds */
+        uint64_t max_ns = 0; /**< Time taken by its slowest run, in nanoseconds */
+    };
+
+    /**
+     * Tables that can be searched with search_records
+     */
+    enum search_source {
+        MOD_RECORDS,
+        BAN_APPEALS,
+        STAFF_APPLICATIONS
+    };
+
+    /**
+     * A full-text search match
+     */
+    struct search_result {
+        std::string id; /**< Log message ID for mod records, rowid for appeals and applications */
+        dpp::snowflake user; /**< ID of user the record is about */
+        std::string kind; /**< Action type for mod records, status for appeals, application type for applications */
+        std::string snippet; /**< Matching text, with matches in bold */
+    };
+
+    template<>
+    struct row_mapping<search_result> : member_mapping<&search_result::id, &search_result::user, &search_result::kind, &search_result::snippet> {};
+
+    /**
+     * Number of actions of one type taken by a moderator, summed from the mod_stats rollup
+     */
+    struct mod_stat {
+        dpp::snowflake moderator; /**< ID of moderator who took the actions */
+        std::string type; /**< Type of action (Warning, Mute, Timeout, Kick, Ban, Unwarn) */
+        uint64_t count = 0; /**< Number of actions */
+    };
+
+    template<>
+    struct row_mapping<mod_stat> : member_mapping<&mod_stat::moderator, &mod_stat::type, &mod_stat::count> {};
+
+    /**
+     * Least-recently-used cache of users' moderation records in every server, bounded to N users
+     * @tparam N Maximum number of users to keep records for
+     */
+    template<size_t N>
+    class mod_record_cache {
+        std::mutex mutex; /**< Guards everything below, and is held while a cache miss is loaded from the DB */
+        std::list<dpp::snowflake> usage; /**< Cached users, most recently used first */
+        std::unordered_map<dpp::snowflake, std::pair<std::vector<mod_record>, std::list<dpp::snowflake>::iterator>> entries;
+
+        /**
+         * Find a user's cached records and mark them as most recently used. Caller must hold the mutex.
+         * @param user ID of user to find
+         * @return Pointer to the user's records, or nullptr if they aren't cached
+         */
+        std::vector<mod_record>* find(const dpp::snowflake user) {
+            auto it = entries.find(user);
+            if (it == entries.end()) {
+                return nullptr;
+            }
+            usage.splice(usage.begin(), usage, it->second.second);
+            return &it->second.first;
+        }
+        public:
+            /**
+             * Get a user's records, loading them with the given function on a cache miss
+             * @param user ID of user to get records for
+             * @param records Vector to append the records to
+             * @param load Function that appends a user's records from the DB to a vector, returning false on failure
+             * @return true if the records were found in the cache or loaded successfully
+             */
+            bool get(const dpp::snowflake user, std::vector<mod_record>& records, const std::function<bool(std::vector<mod_record>&)>& load) {
+                std::lock_guard lock(mutex);
+                if (const std::vector<mod_record>* cached = find(user); cached != nullptr) {
+                    records.insert(records.end(), cached->begin(), cached->end());
+                    return true;
+                }
+                std::vector<mod_record> loaded;
+                if (!load(loaded)) {
+                    return false;
+                }
+                // Evict the least recently used user if the cache is full
+                if (entries.size() >= N) {
+                    entries.erase(usage.back());
+                    usage.pop_back();
+                }
+                usage.push_front(user);
+                records.insert(records.end(), loaded.begin(), loaded.end());
+                entries.emplace(user, std::make_pair(std::move(loaded), usage.begin()));
+                return true;
+            }
+            /**
+             * Add a new record to its user's cached records, if that user is cached
+             * @param record Record to add
+             */
+            void add(const mod_record& record) {
+                std::lock_guard lock(mutex);
+                std::vector<mod_record>* records = find(record.user);
+                // A concurrent cache miss may have already loaded this record from the DB
+                if (records != nullptr && std::ranges::none_of(*records, [&record](const mod_record& r){return r.id == record.id;})) {
+                    records->push_back(record);
+                }
+            }
+            /**
+             * Drop every cached record, so they are all reloaded from the DB on next use
+             */
+            void clear() {
+                std::lock_guard lock(mutex);
+                entries.clear();
+                usage.clear();
+            }
+            /**
+             * Mark cached records of a user inactive
+             * @param user ID of user the records are against
+             * @param matches Predicate selecting which of the user's records to deactivate
+             */
+            void deactivate(const dpp::snowflake user, const std::function<bool(const mod_record&)>& matches) {
+                std::lock_guard lock(mutex);
+                if (std::vector<mod_record>* records = find(user); records != nullptr) {
+                    for (mod_record& record : *records) {
+                        if (matches(record)) {
+                            record.active = false;
+                        }
+                    }
+                }
+            }
+    };
+
+    /**
+     * Global cache of the moderation records of the 500 most recently looked up users
+     */
+    inline mod_record_cache<500> MOD_RECORD_CACHE;
+
+    /**
+     * Get all moderation records against a user in a server, from the cache if possible
+     * @param db SQLite DB pointer to query on a cache miss
+     * @param guild ID of the server the records are from
+     * @param user ID of user to get records for
+     * @param records Vector to append the records to
+     * @return true if the records were found
+     */
+    bool get_mod_records(sqlite3* db, dpp::snowflake guild, dpp::snowflake user, std::vector<mod_record>& records);
+
+    /**
+     * Get all moderation records against a user in a server that have been moved to the archive
+     * @param db SQLite DB pointer with the archive attached
+     * @param guild ID of the server the records are from
+     * @param user ID of user to get records for
+     * @param records Vector to append the records to
+     * @return true if the records were found
+     */
+    bool get_archived_mod_records(sqlite3* db, dpp::snowflake guild, dpp::snowflake user, std::vector<mod_record>& records);
+
+    /**
+     * Get one page of a user's moderation records in a server in ID order, querying only that page from each schema
+     * @param db SQLite DB pointer to query
+     * @param guild ID of the server the records are from
+     * @param user ID of user to get records for
+     * @param cursor ID of the record just outside the page: the last one before it when paging forward,
+     *               or the first one after it when paging backward. 0 gets the first page.
+     * @param forward Whether the page comes after the cursor or before it
+     * @param archived Whether to include records that have been moved to the archive
+     * @param limit Maximum number of records on the page
+     * @param records Vector to append the page to
+     * @return true if the query succeeded
+     */
+    bool get_mod_records_page(sqlite3* db, dpp::snowflake guild, dpp::snowflake user, dpp::snowflake cursor, bool forward, bool archived, unsigned int limit, std::vector<mod_record>& records);
+
+    /**
+     * Count a user's moderation records in a server
+     * @param db SQLite DB pointer to query
+     * @param guild ID of the server the records are from
+     * @param user ID of user to count records for
+     * @param archived Whether to include records that have been moved to the archive
+     * @param count Set to the number of records
+     * @return true if the query succeeded
+     */
+    bool count_mod_records(sqlite3* db, dpp::snowflake guild, dpp::snowflake user, bool archived, uint64_t& count);
+
+    /**
+     * Insert a moderation record, along with its mutes table row if it's a mute, and add it to the cache.
+     * The moderator's count for the day in mod_stats is incremented in the same transaction.
+     * @param db SQLite DB pointer to insert into
+     * @param record Record to add, including the server it's from. For mutes, extra_data is set to the new mutes table row ID.
+     * @return true if the record was inserted
+     */
+    bool add_mod_record(sqlite3* db, mod_record& record);
+
+    /**
+     * Mark a moderation record inactive in the DB and cache
+     * @param db SQLite DB pointer to update
+     * @param user ID of user the record is against
+     * @param id ID of the record
+     * @return true if the update succeeded
+     */
+    bool deactivate_mod_record(sqlite3* db, dpp::snowflake user, dpp::snowflake id);
+
+    /**
+     * Mark a warning inactive and count it as an Unwarn by the moderator who removed it, in one transaction
+     * @param db SQLite DB pointer to update
+     * @param guild ID of the server the warning must be from
+     * @param user ID of user the warning is against
+     * @param id ID of the warning
+     * @param moderator ID of moderator removing the warning
+     * @return true if the update succeeded
+     */
+    bool remove_warning(sqlite3* db, dpp::snowflake guild, dpp::snowflake user, dpp::snowflake id, dpp::snowflake moderator);
+
+    /**
+     * Get the number of actions of each type taken by each moderator in a server over the past few days, from the mod_stats rollup
+     * @param db SQLite DB pointer to query
+     * @param guild ID of the server to get stats for
+     * @param moderator ID of moderator to get stats for, or 0 for every moderator
+     * @param days Number of days to include, counting today
+     * @param stats Vector to append the totals to, ordered by moderator
+     * @return true if the query succeeded
+     */
+    bool get_mod_stats(sqlite3* db, dpp::snowflake guild, dpp::snowflake moderator, unsigned int days, std::vector<mod_stat>& stats);
+
+    /**
+     * Mark the moderation record for a mute inactive in the DB and cache
+     * @param db SQLite DB pointer to update
+     * @param mute Mute that has ended
+     * @return true if the update succeeded
+     */
+    bool deactivate_mute(sqlite3* db, const util::mute& mute);
+
+    /**
+     * Get the mutes still marked active that end within a time range, in every server
+     * @param db SQLite DB pointer to query
+     * @param since Start of the range. If 0, every active mute ending before until is included, along with any that can't be timed.
+     * @param until End of the range, exclusive
+     * @param mutes Vector to append the mutes to
+     * @return true if the query succeeded
+     */
+    bool get_active_mutes(sqlite3* db, time_t since, time_t until, std::vector<util::mute>& mutes);
+
+    /**
+     * Get the reminders that haven't been sent and end before a given time, from every server
+     * @param db SQLite DB pointer to query
+     * @param until End of the range, exclusive
+     * @param reminders Vector to append the reminders to
+     * @return true if the query succeeded
+     */
+    bool get_reminders(sqlite3* db, time_t until, std::vector<util::reminder>& reminders);
+
+    /**
+     * Get every value in bot_state for a server. bot_state holds the bot's own state that needs to survive a restart.
+     * @param db SQLite DB pointer to query
+     * @param guild ID of the server the values are for, or 0 for ones that aren't for any server
+     * @param state Map to add the values to, by key
+     * @return true if the query succeeded
+     */
+    bool get_state(sqlite3* db, dpp::snowflake guild, std::map<std::string, int64_t>& state);
+
+    /**
+     * Set values in bot_state for a server, all in one statement so they change together
+     * @param db SQLite DB pointer to update
+     * @param guild ID of the server the values are for, or 0 for ones that aren't for any server
+     * @param state Values to set, by key
+     * @return true if the update succeeded
+     */
+    bool set_state(sqlite3* db, dpp::snowflake guild, const std::map<std::string, int64_t>& state);
+
+    /**
+     * Delete values from bot_state for a server, all in one statement so they change together
+     * @param db SQLite DB pointer to update
+     * @param guild ID of the server the values are for, or 0 for ones that aren't for any server
+     * @param keys Keys of the values to delete
+     * @return true if the delete succeeded
+     */
+    bool delete_state(sqlite3* db, dpp::snowflake guild, const std::vector<std::string>& keys);
+
+    /**
+     * Bring a DB created by an older create_database.sh up to date with the current schema.
+     * Rows from before the DB was partitioned by server are given to the main server.
+     * @param db SQLite DB pointer to set up
+     * @param main_guild ID of the main server
+     * @return true if the schema is up to date
+     */
+    bool init_schema(sqlite3* db, dpp::snowflake main_guild);
+
+    /**
+     * Create the full-text indexes and the triggers that keep them in sync if the DB doesn't have them yet,
+     * indexing any existing rows
+     * @param db SQLite DB pointer to set up
+     * @return true if the indexes are ready to use
+     */
+    bool init_search(sqlite3* db);
+
+    /**
+     * Full-text search a table, best matches first
+     * @param db SQLite DB pointer to query
+     * @param guild ID of the server to search mod records from. Ban appeals and staff applications aren't kept by server.
+     * @param source Table to search
+     * @param query FTS5 query string
+     * @param limit Maximum number of results
+     * @param results Vector to append the results to
+     * @return true if the query succeeded, false if it failed or was malformed
+     */
+    bool search_records(sqlite3* db, dpp::snowflake guild, search_source source, std::string_view query, unsigned int limit, std::vector<search_result>& results);
+
+    /**
+     * Time every statement run on a connection and keep per-statement totals.
+     * Statements are grouped with their literals replaced by "?", and slow ones are logged in full.
+     * @param db SQLite DB pointer to profile
+     * @param slow_threshold Statements taking at least this long are logged
+     */
+    void enable_profiling(sqlite3* db, std::chrono::milliseconds slow_threshold);
+
+    /**
+     * Get the totals for every statement run since profiling was enabled
+     * @return Normalized statements and their totals, slowest overall first
+     */
+    std::vector<std::pair<std::string, query_stats>> get_query_stats();
+
+    /**
+     * Copy the DB to a file a few pages at a time, so other queries are never blocked for long
+     * @param db SQLite DB pointer to back up
+     * @param path Path of the backup file, which is only created once the copy has finished
+     * @param pages_per_step Number of pages to copy while holding the DB lock
+     * @param step_delay Time to sleep between steps, letting other queries run
+     * @param stop Token to abandon the backup early
+     * @return true if the backup completed
+     */
+    bool backup(sqlite3* db, const std::filesystem::path& path, int pages_per_step, std::chrono::milliseconds step_delay, const std::stop_token& stop);
+
+    /**
+     * Start a thread that backs up the DB periodically according to the "backup" config section
+     * @param db SQLite DB pointer to back up
+     * @param config Bot config
+     * @param db_file Path of the DB file, used to name backups
+     * @param data_path Data path that the backup directory is relative to
+     * @return The backup thread, or a thread with no associated thread if backups aren't configured
+     */
+    std::jthread start_backups(sqlite3* db, const nlohmann::json& config, const std::filesystem::path& db_file, const std::filesystem::path& data_path);
+
+    /**
+     * Attach the archive DB as schema "archive", creating its tables if needed.
+     * Also switches the main DB to incremental auto-vacuum, which requires a one-time full VACUUM.
+     * @param db SQLite DB pointer to attach the archive to
+     * @param path Path of the archive DB file
+     * @param main_guild ID of the main server, which rows archived before the DB was partitioned by server are given to
+     * @return true if the archive is attached
+     */
+    bool attach_archive(sqlite3* db, const std::filesystem::path& path, dpp::snowflake main_guild);
+
+    /**
+     * Attach the archive and start a thread that periodically moves old inactive records into it
+     * according to the "archive" config section, then returns the freed pages to the filesystem.
+     * Archived rows leave the full-text indexes, so /search-records no longer finds them; archived
+     * mod records can still be listed with /warnings.
+     * @param db SQLite DB pointer to archive from
+     * @param config Bot config
+     * @param data_path Data path that the archive file is relative to
+     * @return The archive thread, or a thread with no associated thread if archiving isn't configured or the archive couldn't be attached
+     */
+    std::jthread start_archiving(sqlite3* db, const nlohmann::json& config, const std::filesystem::path& data_path);
+}
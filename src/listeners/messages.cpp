@@ -42,8 +42,8 @@ void messages::add_message_content_fields(dpp::embed& embed, const dpp::message&
     }
 }
 
-void messages::on_message(const dpp::message_create_t& event, const nlohmann::json& config, bool& bump_timer_running) {
-    util::MESSAGE_CACHE.push(event.msg);
+void messages::on_message(const dpp::message_create_t& event, const settings::typed_config& config, sqlite3* db) {
+    util::message_cache(event.msg.guild_id).push(event.msg);
     if (event.msg.author == event.owner->me) {
         return;
     }
@@ -53,38 +53,31 @@ void messages::on_message(const dpp::message_create_t& event, const nlohmann::js
                                        .add_field("User ID", event.msg.author.id.str(), true);
         add_message_content_fields(embed, event.msg);
         // Send embed to log
-        event.owner->message_create(dpp::message(config["log_channel_ids"]["bot_dm"], embed));
-    // DISBOARD bump confirmation message
-    } else if (event.msg.author.id == config["disboard_bot_id"].get<dpp::snowflake>()  && event.msg.embeds.size() == 1) {
+        event.owner->message_create(dpp::message(config.log_channel_ids.bot_dm, embed));
+    // DISBOARD bump confirmation message. Each server has its own bump timer.
+    } else if (event.msg.author.id == config.disboard_bot_id && event.msg.embeds.size() == 1) {
         if (event.msg.embeds[0].description.find(":thumbsup:") != std::string::npos) {
+            const dpp::guild* guild = dpp::find_guild(config.guild_id);
             event.owner->message_create(dpp::message(event.msg.channel_id, dpp::embed()
                 .set_color(util::color::DEFAULT).set_title("Thank you for bumping the server!")
-                .set_description("Vote for Tech Support Central on top.gg at https://top.gg/servers/" + event.msg.guild_id.str())));
-            if (!bump_timer_running) {
-                bump_timer_running = true;
-                util::handle_bump(event.owner, config, event.msg.channel_id, 7200, bump_timer_running);
-            }
+                .set_description(std::format("Vote for {} on top.gg at https://top.gg/servers/{}",
+                                             guild != nullptr ? guild->name : "this server", config.guild_id.str()))));
+            // Does nothing if the timer is already running
+            util::start_bump_timer(event.owner, db, config.guild_id, event.msg.channel_id, 7200);
         }
     } else if (event.msg.content.find("need help") != std::string::npos) {
-        bool msg_in_public_nonsupport_channel = false;
-        for (const auto& channel : config["public_channel_ids"]) {
-            if (event.msg.channel_id == channel.get<dpp::snowflake>()) {
-                msg_in_public_nonsupport_channel = true;
-                break;
-            }
-        }
-        if (msg_in_public_nonsupport_channel) {
+        if (config.is_public_channel(event.msg.channel_id)) {
             event.reply(dpp::message(std::format(
                 "If you're looking for help, please go to a support channel like <#{}> and ping the <@&{}>.",
-                config["support_channel_ids"]["general_support"].get<uint64_t>(), config["role_ids"]["support_team"].get<uint64_t>()
+                static_cast<uint64_t>(config.support_channel_ids.general_support), static_cast<uint64_t>(config.role_ids.support_team)
             )).set_allowed_mentions(false));
         }
     }
 }
 
 // TODO: cache images sent in deleted messages
-dpp::task<> messages::on_message_deleted(const dpp::message_delete_t& event, const nlohmann::json& config) {
-    dpp::confirmation_callback_t msg_conf = co_await util::get_message_cached(event.owner, event.id, event.channel_id);
+dpp::task<> messages::on_message_deleted(const dpp::message_delete_t& event, const settings::typed_config& config) {
+    dpp::confirmation_callback_t msg_conf = co_await util::get_message_cached(event.owner, event.guild_id, event.id, event.channel_id);
     dpp::embed embed = dpp::embed().set_color(util::color::RED).set_title("Message Deleted")
                                    .add_field("In channel", std::format("<#{}>", event.channel_id.str()), false);
     if (msg_conf.is_error()) {
@@ -96,12 +89,12 @@ dpp::task<> messages::on_message_deleted(const dpp::message_delete_t& event, con
         if (message.author.id == event.owner->me.id) {
             co_return;
         }
-        dpp::confirmation_callback_t member_conf = co_await event.owner->co_guild_get_member(config["guild_id"], message.author.id);
-        if (!member_conf.is_error()) {
-            std::vector<dpp::snowflake> roles = std::get<dpp::guild_member>(member_conf.value).get_roles();
-            if (std::ranges::find(roles, config["role_ids"]["owner"].get<dpp::snowflake>()) != roles.end()) {
-                co_return;
-            }
+        uint8_t staff_roles;
+        if (!util::find_staff_roles(config.guild_id, message.author.id, staff_roles)) {
+            staff_roles = co_await util::get_staff_roles(event.owner, config, message.author.id);
+        }
+        if (staff_roles & util::STAFF_OWNER) {
+            co_return;
         }
 
         embed.set_thumbnail(message.author.get_avatar_url());
@@ -110,20 +103,20 @@ dpp::task<> messages::on_message_deleted(const dpp::message_delete_t& event, con
         add_message_content_fields(embed, message);
     }
     // Send embed to log
-    event.owner->message_create(dpp::message(config["log_channel_ids"]["message_deleted"], embed));
+    event.owner->message_create(dpp::message(config.log_channel_ids.message_deleted, embed));
 }
 
-dpp::task<> messages::on_message_edited(const dpp::message_update_t& event, const nlohmann::json& config) {
+dpp::task<> messages::on_message_edited(const dpp::message_update_t& event, const settings::typed_config& config) {
     // Bot and owners are exempt from log
     if (event.msg.author.id == event.owner->me.id) {
         co_return;
     }
-    dpp::confirmation_callback_t member_conf = co_await event.owner->co_guild_get_member(config["guild_id"], event.msg.author.id);
-    if (!member_conf.is_error()) {
-        std::vector<dpp::snowflake> roles = std::get<dpp::guild_member>(member_conf.value).get_roles();
-        if (std::ranges::find(roles, config["role_ids"]["owner"].get<dpp::snowflake>()) != roles.end()) {
-            co_return;
-        }
+    uint8_t staff_roles;
+    if (!util::find_staff_roles(config.guild_id, event.msg.author.id, staff_roles)) {
+        staff_roles = co_await util::get_staff_roles(event.owner, config, event.msg.author.id);
+    }
+    if (staff_roles & util::STAFF_OWNER) {
+        co_return;
     }
 
     dpp::embed embed = dpp::embed().set_color(util::color::DEFAULT).set_title("Message Edited").set_thumbnail(event.msg.author.get_avatar_url())
@@ -133,14 +126,15 @@ dpp::task<> messages::on_message_edited(const dpp::message_update_t& event, cons
                                    .add_field("User ID", event.msg.author.id.str(), true);
 
     // Try to get old message from cache, searching backwards (latest to earliest messages)
-    auto it = util::MESSAGE_CACHE.end();
-    while (it-- != util::MESSAGE_CACHE.begin()) {
+    util::cache<dpp::message, 1000>& messages = util::message_cache(event.msg.guild_id);
+    auto it = messages.end();
+    while (it-- != messages.begin()) {
         if (it->id == event.msg.id) {
             break;
         }
     }
     // If message was not in cache, we can't figure out what the edits were
-    if (it == util::MESSAGE_CACHE.begin() - 1) {
+    if (it == messages.begin() - 1) {
         add_message_content_fields(embed, event.msg);
         embed.set_footer(dpp::embed_footer().set_text("Could not determine what was edited (message not in cache)"));
     } else {
@@ -158,14 +152,14 @@ dpp::task<> messages::on_message_edited(const dpp::message_update_t& event, cons
         *it = event.msg;
     }
     // Send embed to log
-    event.owner->message_create(dpp::message(config["log_channel_ids"]["message_edited"], embed));
+    event.owner->message_create(dpp::message(config.log_channel_ids.message_edited, embed));
 }
 
-dpp::task<> messages::on_reaction(const dpp::message_reaction_add_t& event, const nlohmann::json& config) {
-    if (event.message_id == config["listen_message_ids"]["bump_reminders"].get<dpp::snowflake>() && event.reacting_emoji.name == dpp::unicode_emoji::white_check_mark) {
+dpp::task<> messages::on_reaction(const dpp::message_reaction_add_t& event, const settings::typed_config& config) {
+    if (event.message_id == config.listen_message_ids.bump_reminders && event.reacting_emoji.name == dpp::unicode_emoji::white_check_mark) {
         std::vector<dpp::snowflake> roles = event.reacting_member.get_roles();
-        if (std::ranges::find(roles, config["role_ids"]["bump_reminder"].get<dpp::snowflake>()) == roles.end()) {
-            dpp::confirmation_callback_t role_add_conf = co_await event.owner->co_guild_member_add_role(event.reacting_guild.id, event.reacting_user.id, config["role_ids"]["bump_reminder"]);
+        if (std::ranges::find(roles, config.role_ids.bump_reminder) == roles.end()) {
+            dpp::confirmation_callback_t role_add_conf = co_await event.owner->co_guild_member_add_role(event.reacting_guild.id, event.reacting_user.id, config.role_ids.bump_reminder);
             if (role_add_conf.is_error()) {
                 event.owner->direct_message_create(event.reacting_user.id, dpp::message("Failed to add bump reminder role; please contact the owners for assistance."));
             } else {
@@ -174,12 +168,12 @@ dpp::task<> messages::on_reaction(const dpp::message_reaction_add_t& event, cons
         } else {
             event.owner->direct_message_create(event.reacting_user.id, dpp::message("Cannot add bump reminder role (you already have it)."));
         }
-    } else if (event.message_id == config["listen_message_ids"]["ticket_create"].get<dpp::snowflake>() && event.reacting_emoji.name == dpp::unicode_emoji::tickets) {
+    } else if (event.message_id == config.listen_message_ids.ticket_create && event.reacting_emoji.name == dpp::unicode_emoji::tickets) {
         // Create private thread for ticket
         std::string title = std::string("Ticket for ") + event.reacting_user.username;
-        dpp::snowflake channel_id = config["log_channel_ids"]["tickets"];
+        dpp::snowflake channel_id = config.log_channel_ids.tickets;
         dpp::confirmation_callback_t confirmation = co_await event.owner->co_thread_create
-        (title, channel_id, config["ticket_auto_archive_mins"], dpp::CHANNEL_PRIVATE_THREAD, false, 0);
+        (title, channel_id, config.ticket_auto_archive_mins, dpp::CHANNEL_PRIVATE_THREAD, false, 0);
         if (confirmation.is_error()) {
             event.owner->direct_message_create(event.reacting_user.id, dpp::message("Failed to create ticket channel."));
         }
@@ -187,21 +181,21 @@ dpp::task<> messages::on_reaction(const dpp::message_reaction_add_t& event, cons
         // Mention moderators to add them to ticket and notify them at the same time
         event.owner->message_create(dpp::message(thread.id, event.reacting_user.get_mention()
         + std::format(", your ticket has been created. Please explain your rationale and wait for a <@&{}> to respond.",
-        config["role_ids"]["muted"].get<uint64_t>())).set_allowed_mentions(true, true));
+        static_cast<uint64_t>(config.role_ids.muted))).set_allowed_mentions(true, true));
         // Remove reaction
         event.owner->message_delete_reaction(event.message_id, event.channel_id, event.reacting_user.id, dpp::unicode_emoji::tickets);
     }
 }
 
-dpp::task<> messages::on_reaction_removed(const dpp::message_reaction_remove_t& event, const nlohmann::json& config) {
-    if (event.message_id == config["listen_message_ids"]["bump_reminders"].get<dpp::snowflake>() && event.reacting_emoji.name == dpp::unicode_emoji::white_check_mark) {
+dpp::task<> messages::on_reaction_removed(const dpp::message_reaction_remove_t& event, const settings::typed_config& config) {
+    if (event.message_id == config.listen_message_ids.bump_reminders && event.reacting_emoji.name == dpp::unicode_emoji::white_check_mark) {
         dpp::confirmation_callback_t member_conf = co_await event.owner->co_guild_get_member(event.reacting_guild.id, event.reacting_user_id);
         if (!member_conf.is_error()) {
             std::vector<dpp::snowflake> roles = std::get<dpp::guild_member>(member_conf.value).get_roles();
-            if (std::ranges::find(roles, config["role_ids"]["bump_reminder"].get<dpp::snowflake>()) == roles.end()) {
+            if (std::ranges::find(roles, config.role_ids.bump_reminder) == roles.end()) {
                 event.owner->direct_message_create(event.reacting_user_id, dpp::message("Cannot remove bump reminder role (you don't have it)."));
             } else {
-                dpp::confirmation_callback_t role_remove_conf = co_await event.owner->co_guild_member_remove_role(event.reacting_guild.id, event.reacting_user_id, config["role_ids"]["bump_reminder"]);
+                dpp::confirmation_callback_t role_remove_conf = co_await event.owner->co_guild_member_remove_role(event.reacting_guild.id, event.reacting_user_id, config.role_ids.bump_reminder);
                 if (role_remove_conf.is_error()) {
                     event.owner->direct_message_create(event.reacting_user_id, dpp::message("Failed to remove bump reminder role; please contact the owners for assistance."));
                 } else {
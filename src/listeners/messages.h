@@ -13,7 +13,9 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #pragma once
+#include "../settings.h"
 #include <dpp/dpp.h>
+#include <sqlite3.h>
 
 namespace messages {
     /**
@@ -24,9 +26,9 @@ namespace messages {
     void add_message_content_fields(dpp::embed& embed, const dpp::message& message);
 
     // Event handlers
-    void on_message(const dpp::message_create_t& event, const nlohmann::json& config, bool& bump_timer_running);
-    dpp::task<> on_message_deleted(const dpp::message_delete_t& event, const nlohmann::json& config);
-    dpp::task<> on_message_edited(const dpp::message_update_t& event, const nlohmann::json& config);
-    dpp::task<> on_reaction(const dpp::message_reaction_add_t& event, const nlohmann::json& config);
-    dpp::task<> on_reaction_removed(const dpp::message_reaction_remove_t& event, const nlohmann::json& config);
+    void on_message(const dpp::message_create_t& event, const settings::typed_config& config, sqlite3* db);
+    dpp::task<> on_message_deleted(const dpp::message_delete_t& event, const settings::typed_config& config);
+    dpp::task<> on_message_edited(const dpp::message_update_t& event, const settings::typed_config& config);
+    dpp::task<> on_reaction(const dpp::message_reaction_add_t& event, const settings::typed_config& config);
+    dpp::task<> on_reaction_removed(const dpp::message_reaction_remove_t& event, const settings::typed_config& config);
 }
\ No newline at end of file
@@ -21,11 +21,451 @@
 #include "listeners/messages.h"
 #include "listeners/automod_rules.h"
 #include "util.h"
+#include "db.h"
+#include "scheduler.h"
+#include "settings.h"
+#include "autocomplete.h"
+#include "command_table.h"
+#include "builtin_command_names.h"
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 
 std::string DATA_PATH;
 std::string DB_FILE;
 
+/**
+ * What slash command handlers can use besides the event
+ */
+struct command_context {
+    const nlohmann::json& config; /**< JSON bot config data */
+    const settings::typed_config& typed_config; /**< Typed bot config data, from the same version of config.json */
+    sqlite3* db; /**< SQLite DB pointer */
+    std::unordered_map<std::string, db_commands::text_command>& db_text_commands; /**< Text commands from the DB */
+    std::unordered_map<std::string, db_commands::embed_command>& db_embed_commands; /**< Embed commands from the DB */
+};
+using command_handler = dpp::task<>(*)(const dpp::slashcommand_t&, const command_context&);
+
+/**
+ * Built-in slash commands. Anything not in here is looked up in the DB commands.
+ */
+static constexpr commands::command_table BUILTIN_COMMANDS(std::to_array<std::pair<std::string_view, command_handler>>({
+    {"add-text-command", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        db_commands::add_text_command_modal(event);
+        co_return;
+    }},
+    {"add-embed-command", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await db_commands::add_embed_command(event, context.config, context.db_embed_commands, context.db);
+    }},
+    {"add-embed-command-field", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        db_commands::add_embed_command_field_modal(event, context.db_embed_commands);
+        co_return;
+    }},
+    {"remove-embed-command-field", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        db_commands::remove_embed_command_field_menu(event, context.db_embed_commands, context.db);
+        co_return;
+    }},
+    {"edit-embed-command-field", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        db_commands::edit_embed_command_field_menu(event, context.db_embed_commands, context.db);
+        co_return;
+    }},
+    {"remove-db-command", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await db_commands::remove_command(event, context.config, context.db_text_commands, context.db_embed_commands, context.db);
+    }},
+    {"db-command-list", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        db_commands::get_commands(event, context.db_text_commands, context.db_embed_commands);
+        co_return;
+    }},
+    {"ping", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        meta::ping(event);
+        co_return;
+    }},
+    {"uptime", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        meta::uptime(event);
+        co_return;
+    }},
+    {"commit", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        meta::get_commit(event);
+        co_return;
+    }},
+    {"db-stats", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        meta::db_stats(event);
+        co_return;
+    }},
+    {"sendmessage", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        co_await meta::send_message(event);
+    }},
+    {"announce", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await meta::announce(event, context.config);
+    }},
+    {"dm", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await meta::dm(event, context.config);
+    }},
+    {"remindme", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        meta::remindme(event, context.typed_config, context.db);
+        co_return;
+    }},
+    {"reminders", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        meta::reminders(event, context.db);
+        co_return;
+    }},
+    {"set-bump-timer", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        meta::set_bump_timer(event, context.typed_config, context.db);
+        co_return;
+    }},
+    {"appeal-respond", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        meta::appeal_respond(event, context.db);
+        co_return;
+    }},
+    {"application-respond", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await meta::application_respond(event, context.config, context.db);
+    }},
+    {"rules", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        server_info::rules(event, context.config);
+        co_return;
+    }},
+    {"rule", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        server_info::rule(event, context.config);
+        co_return;
+    }},
+    {"suggest", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        server_info::suggest(event, context.config);
+        co_return;
+    }},
+    {"suggestion-respond", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await server_info::suggestion_response(event, context.config);
+    }},
+    {"create-ticket", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::create_ticket(event, context.config);
+    }},
+    {"purge", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::purge(event, context.config);
+    }},
+    {"userinfo", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        moderation::userinfo(event, context.config);
+        co_return;
+    }},
+    {"inviteinfo", [](const dpp::slashcommand_t& event, const command_context&) -> dpp::task<> {
+        co_await moderation::inviteinfo(event);
+    }},
+    {"warn", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::warn(event, context.config, context.typed_config, context.db);
+    }},
+    {"unwarn", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::unwarn(event, context.config, context.typed_config, context.db);
+    }},
+    {"mute", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::mute(event, context.config, context.typed_config, context.db);
+    }},
+    {"unmute", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::unmute(event, context.config, context.typed_config, context.db);
+    }},
+    {"kick", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::kick(event, context.config, context.typed_config, context.db);
+    }},
+    {"ban", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::ban(event, context.config, context.typed_config, context.db);
+    }},
+    {"unban", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        co_await moderation::unban(event, context.config, context.typed_config, context.db);
+    }},
+    {"warnings", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        moderation::get_mod_actions(event, context.typed_config, context.db);
+        co_return;
+    }},
+    {"search-records", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        moderation::search_records(event, context.typed_config, context.db);
+        co_return;
+    }},
+    {"modstats", [](const dpp::slashcommand_t& event, const command_context& context) -> dpp::task<> {
+        moderation::mod_stats(event, context.typed_config, context.db);
+        co_return;
+    }}
+}));
+static_assert(BUILTIN_COMMANDS.size() == commands::BUILTIN_COMMAND_NAMES.size() &&
+              std::ranges::all_of(commands::BUILTIN_COMMAND_NAMES, [](const std::string_view name) {
+                  return BUILTIN_COMMANDS.find(name) != nullptr;
+              }), "BUILTIN_COMMAND_NAMES must list exactly the commands in BUILTIN_COMMANDS");
+
+/**
+ * Built-in commands that work on things only the main server has: the DB commands, ban appeals and staff applications.
+ * They aren't registered in partner servers.
+ */
+static constexpr std::array<std::string_view, 9> MAIN_GUILD_COMMANDS = {
+    "add-text-command", "add-embed-command", "add-embed-command-field", "remove-embed-command-field", "edit-embed-command-field",
+    "remove-db-command", "db-command-list", "appeal-respond", "application-respond"
+};
+
+/**
+ * 64-bit FNV-1a hash, which stays the same across builds so it can be stored
+ * @param data Data to hash
+ * @return Hash of the data
+ */
+static uint64_t fnv1a(const std::string_view data) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : data) {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+/**
+ * Register slash commands with Discord, only sending what changed since the last time.
+ * A hash of every registered command is kept in bot_state; if they all match there's nothing to send.
+ * Otherwise, new commands are created, changed ones edited and removed ones deleted, or if nothing
+ * has been recorded yet, the whole set is registered at once. Either way, the global and main server
+ * commands Discord ends up with are put in the local command index that util::find_command searches.
+ * @param bot Cluster to register commands with
+ * @param db SQLite DB pointer with the hashes of the registered commands
+ * @param commands Commands that should be registered
+ * @param guild_id Server to register the commands in, or 0 for global commands
+ */
+static dpp::job sync_commands(dpp::cluster* bot, sqlite3* db, std::vector<dpp::slashcommand> commands, const dpp::snowflake guild_id) {
+    const std::string scope = guild_id == 0 ? "global" : std::format("server {}", guild_id.str());
+    const std::string prefix = std::format("commands:{}:", guild_id == 0 ? "global" : "guild");
+    // The index only holds the main server's commands, which are the ones the DB commands are managed in
+    const std::shared_ptr<const settings::typed_config> typed = settings::typed(guild_id);
+    const bool index = guild_id == 0 || (typed != nullptr && typed->main_guild);
+    std::map<std::string, int64_t> state;
+    if (!db::get_state(db, guild_id, state)) {
+        util::log("ERROR", std::format("Failed to load registered {} command hashes from DB", scope));
+    }
+    std::map<std::string, int64_t> registered_hashes;
+    for (auto it = state.lower_bound(prefix); it != state.end() && it->first.starts_with(prefix); ++it) {
+        registered_hashes.emplace(it->first.substr(prefix.size()), it->second);
+    }
+    std::map<std::string, int64_t> hashes;
+    for (const dpp::slashcommand& command : commands) {
+        hashes.emplace(command.name, static_cast<int64_t>(fnv1a(command.build_json())));
+    }
+
+    std::map<std::string, int64_t> new_hashes;
+    if (registered_hashes.empty() && !hashes.empty()) {
+        // Nothing recorded, so the commands Discord has are unknown and all of them get replaced
+        util::log("INFO", std::format("Registering all {} commands", scope));
+        dpp::confirmation_callback_t conf = co_await (guild_id == 0 ? bot->co_global_bulk_command_create(commands)
+                                                                    : bot->co_guild_bulk_command_create(commands, guild_id));
+        if (conf.is_error()) {
+            util::log("ERROR", std::format("Failed to register {} commands: {}", scope, conf.get_error().human_readable));
+            co_return;
+        }
+        if (index) {
+            util::index_commands(std::get<dpp::slashcommand_map>(conf.value), guild_id == 0);
+        }
+        new_hashes = std::move(hashes);
+    } else {
+        // IDs of the registered commands are needed to index, edit and delete them
+        dpp::confirmation_callback_t conf = co_await (guild_id == 0 ? bot->co_global_commands_get() : bot->co_guild_commands_get(guild_id));
+        if (conf.is_error()) {
+            util::log("ERROR", std::format("Failed to get registered {} commands: {}", scope, conf.get_error().human_readable));
+            co_return;
+        }
+        dpp::slashcommand_map registered = std::get<dpp::slashcommand_map>(conf.value);
+        if (hashes == registered_hashes) {
+            if (index) {
+                util::index_commands(registered, guild_id == 0);
+            }
+            co_return;
+        }
+        std::unordered_map<std::string, dpp::snowflake> registered_ids;
+        for (const auto& [id, command] : registered) {
+            registered_ids.emplace(command.name, id);
+        }
+
+        for (dpp::slashcommand& command : commands) {
+            const int64_t hash = hashes[command.name];
+            auto registered_id = registered_ids.find(command.name);
+            auto registered_hash = registered_hashes.find(command.name);
+            if (registered_id != registered_ids.end() && registered_hash != registered_hashes.end() && registered_hash->second == hash) {
+                new_hashes.emplace(command.name, hash);
+                continue;
+            }
+            if (registered_id == registered_ids.end()) {
+                util::log("INFO", std::format("Creating {} command /{}", scope, command.name));
+                conf = co_await (guild_id == 0 ? bot->co_global_command_create(command) : bot->co_guild_command_create(command, guild_id));
+            } else {
+                util::log("INFO", std::format("Updating {} command /{}", scope, command.name));
+                command.id = registered_id->second;
+                conf = co_await (guild_id == 0 ? bot->co_global_command_edit(command) : bot->co_guild_command_edit(command, guild_id));
+            }
+            // A failed command isn't recorded, so it's tried again next time
+            if (conf.is_error()) {
+                util::log("ERROR", std::format("Failed to register {} command /{}: {}", scope, command.name, conf.get_error().human_readable));
+            } else {
+                const dpp::slashcommand& registered_command = std::get<dpp::slashcommand>(conf.value);
+                registered[registered_command.id] = registered_command;
+                new_hashes.emplace(command.name, hash);
+            }
+        }
+        for (const auto& [name, id] : registered_ids) {
+            if (hashes.contains(name)) {
+                continue;
+            }
+            util::log("INFO", std::format("Deleting {} command /{}", scope, name));
+            conf = co_await (guild_id == 0 ? bot->co_global_command_delete(id) : bot->co_guild_command_delete(id, guild_id));
+            // A command that failed to delete keeps its record, so it's tried again next time
+            if (conf.is_error()) {
+                util::log("ERROR", std::format("Failed to delete {} command /{}: {}", scope, name, conf.get_error().human_readable));
+                new_hashes.emplace(name, 0);
+            } else {
+                registered.erase(id);
+            }
+        }
+        if (index) {
+            util::index_commands(registered, guild_id == 0);
+        }
+    }
+
+    std::vector<std::string> old_keys;
+    for (const auto& [name, hash] : registered_hashes) {
+        if (!new_hashes.contains(name)) {
+            old_keys.push_back(prefix + name);
+        }
+    }
+    std::map<std::string, int64_t> new_state;
+    for (const auto& [name, hash] : new_hashes) {
+        new_state.emplace(prefix + name, hash);
+    }
+    db::delete_state(db, guild_id, old_keys);
+    db::set_state(db, guild_id, new_state);
+}
+
+/**
+ * Get the name, description and whether it's global of every text and embed command in the DB.
+ * These are read from the DB rather than the command maps, which slash command handlers change on other threads.
+ * @param db SQLite DB pointer to query
+ * @param commands Vector to append the commands to
+ * @return true if the query succeeded
+ */
+static bool get_db_command_list(sqlite3* db, std::vector<std::tuple<std::string, std::string, bool>>& commands) {
+    return db::query(db, "SELECT name, description, is_global FROM text_commands UNION ALL "
+                         "SELECT command_name, command_description, command_is_global FROM embed_commands;", commands);
+}
+
+/**
+ * Build the slash commands to register from the command list and the DB commands
+ * @param commands JSON command list
+ * @param db DB pointer to read the text and embed commands from
+ * @param application_id ID of the bot's application
+ * @param global_commands Commands that can be used anywhere are added to this
+ * @param tsc_commands Commands that can only be used in the server are added to this
+ * @return false if the DB commands couldn't be read, in which case nothing should be registered
+ */
+static bool build_commands(const nlohmann::json& commands, sqlite3* db, const dpp::snowflake application_id,
+                           std::vector<dpp::slashcommand>& global_commands, std::vector<dpp::slashcommand>& tsc_commands) {
+    for (const auto &category : commands) {
+        for (const auto &command : category) {
+            dpp::slashcommand slash_command(
+                command["name"].get<std::string>(),
+                command["description"].get<std::string>(),
+                application_id
+            );
+
+            for (const auto &option : command["options"]) {
+                dpp::command_option command_option(
+                    option["type"],
+                    option["name"],
+                    option["description"],
+                    option["required"]
+                );
+                if (option.contains("min_value")) {
+                    command_option.set_min_value(option["min_value"].get<int64_t>());
+                }
+                if (option.contains("max_value")) {
+                    command_option.set_max_value(option["max_value"].get<int64_t>());
+                }
+                if (option.contains("min_length")) {
+                    command_option.set_min_length(option["min_length"].get<int64_t>());
+                }
+                if (option.contains("max_length")) {
+                    command_option.set_max_length(option["max_length"].get<int64_t>());
+                }
+                if (option.contains("autocomplete")) {
+                    command_option.set_auto_complete(option["autocomplete"].get<bool>());
+                }
+                for (const auto &choice : option.value("choices", nlohmann::json::array())) {
+                    command_option.add_choice(dpp::command_option_choice(choice["name"], choice["value"].get<std::string>()));
+                }
+                slash_command.add_option(command_option);
+            }
+
+            switch (command.value("permission_level", nlohmann::json()).get<util::command_perms>()) {
+                case util::ADMIN_ONLY:
+                    // Only admins can use the command
+                    slash_command.set_default_permissions(dpp::permissions::p_administrator);
+                    tsc_commands.push_back(slash_command);
+                    break;
+                case util::MOD_ONLY:
+                    // Only users who can see the audit log (moderators) can use the command
+                    slash_command.set_default_permissions(dpp::permissions::p_view_audit_log);
+                    tsc_commands.push_back(slash_command);
+                    break;
+                case util::TRIAL_MOD_ONLY:
+                    // Only users with manage messages (trial mods and mods) can use the command
+                    slash_command.set_default_permissions(dpp::permissions::p_manage_messages);
+                    tsc_commands.push_back(slash_command);
+                    break;
+                case util::STAFF_ONLY:
+                    // Only users who can change their own nickname (staff) can use the command
+                    slash_command.set_default_permissions(dpp::permissions::p_change_nickname);
+                    tsc_commands.push_back(slash_command);
+                    break;
+                case util::GLOBAL:
+                    // This command can be run by anyone, and it can be run anywhere including DMs
+                    slash_command.set_dm_permission(true);
+                    global_commands.push_back(slash_command);
+                    break;
+                case util::SERVER_ONLY:
+                default:
+                    // Default: This command can be run by anyone, but only within the server
+                    tsc_commands.push_back(slash_command);
+                    break;
+            }
+        }
+    }
+    std::vector<std::tuple<std::string, std::string, bool>> db_command_list;
+    if (!get_db_command_list(db, db_command_list)) {
+        return false;
+    }
+    for (const auto& [name, description, global] : db_command_list) {
+        dpp::slashcommand slash_command(name, description, application_id);
+        if (global) {
+            slash_command.set_dm_permission(true);
+            global_commands.push_back(slash_command);
+        } else {
+            tsc_commands.push_back(slash_command);
+        }
+    }
+    return true;
+}
+
+/**
+ * Register the global commands, every server command in the main server, and in each partner server
+ * the built-in server commands that aren't only for the main server
+ * @param bot Cluster to register commands with
+ * @param db DB pointer to read the text and embed commands from, and with the hashes of the registered commands
+ * @return false if the DB commands couldn't be read, in which case nothing was registered
+ */
+static bool register_commands(dpp::cluster* bot, sqlite3* db) {
+    std::vector<dpp::slashcommand> global_commands;
+    std::vector<dpp::slashcommand> tsc_commands;
+    if (!build_commands(*settings::commands(), db, bot->me.id, global_commands, tsc_commands)) {
+        return false;
+    }
+    std::vector<dpp::slashcommand> partner_commands;
+    std::ranges::copy_if(tsc_commands, std::back_inserter(partner_commands), [](const dpp::slashcommand& command) {
+        return BUILTIN_COMMANDS.find(command.name) != nullptr && std::ranges::find(MAIN_GUILD_COMMANDS, command.name) == MAIN_GUILD_COMMANDS.end();
+    });
+    sync_commands(bot, db, std::move(global_commands), 0);
+    for (const dpp::snowflake guild_id : settings::guild_ids()) {
+        const std::shared_ptr<const settings::typed_config> typed = settings::typed(guild_id);
+        if (typed != nullptr) {
+            sync_commands(bot, db, typed->main_guild ? tsc_commands : partner_commands, guild_id);
+        }
+    }
+    return true;
+}
+
 /**
  * Start and run the bot with state initialized from DB and JSON files, and set up event handlers
  * @param argc Number of optional arguments passed
@@ -92,20 +532,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Load JSON files for config and command list
-    std::ifstream config_file = std::ifstream(DATA_PATH + "/config.json");
-    if (config_file.fail()) {
-        std::cerr << "Failed to open config file \"" << DATA_PATH << "/config.json\": " << strerror(errno) << std::endl;
-        return 4;
-    }
-    std::ifstream commands_file = std::ifstream(DATA_PATH + "/commands.json");
-    if (commands_file.fail()) {
-        std::cerr << "Failed to open commands file \"" << DATA_PATH << "/commands.json\": " << strerror(errno) << std::endl;
+    std::string settings_error;
+    if (!settings::load(DATA_PATH, settings_error)) {
+        std::cerr << settings_error << std::endl;
         return 4;
     }
-    nlohmann::json config = nlohmann::json::parse(config_file);
-    nlohmann::json commands = nlohmann::json::parse(commands_file);
-    config_file.close();
-    commands_file.close();
+    // Config as it was at startup, for the settings that are only read once
+    const settings::snapshot config = settings::config();
     // Initialize DB
     sqlite3 *db;
     int status = sqlite3_open(DB_FILE.c_str(), &db);
@@ -113,422 +546,310 @@ int main(int argc, char* argv[]) {
         std::cerr << "Failed to open database \"" << DB_FILE << "\": " << sqlite3_errmsg(db) << std::endl;
         return 2;
     }
+    // Add any indexes, tables and columns this DB predates
+    db::init_schema(db, (*config)["guild_id"].get<uint64_t>());
+    // Time every query and log slow ones
+    db::enable_profiling(db, std::chrono::milliseconds((*config)["slow_query_ms"].get<unsigned int>()));
+    // Start periodic backups, which copy the DB in small steps through this connection
+    std::jthread backup_thread = db::start_backups(db, *config, DB_FILE, DATA_PATH);
+    // Attach the archive and start moving old records into it
+    std::jthread archive_thread = db::start_archiving(db, *config, DATA_PATH);
+    // Start the timer thread that reminders, mute expiries and the bump timer run on
+    std::jthread scheduler_thread = scheduler::start();
 
     std::unordered_map<std::string, db_commands::text_command> db_text_commands;
     std::unordered_map<std::string, db_commands::embed_command> db_embed_commands;
     // Get DB text command list
-    char* error_message;
-    sqlite3_exec(db, "SELECT * FROM text_commands;",
-        [](void* command_list, int column_count, char** column_values, char** column_names) -> int {
-            auto db_text_commands = static_cast<std::unordered_map<std::string, db_commands::text_command>*>(command_list);
-
-            db_commands::text_command text_command;
-            text_command.description = std::string(column_values[1]);
-            text_command.value = std::string(column_values[2]);
-            text_command.global = strcmp(column_values[3], "false");
-
-            db_text_commands->emplace(column_values[0], text_command);
-            return 0;
-        },
-    &db_text_commands, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+    std::vector<std::tuple<std::string, std::string, std::string, bool>> text_command_rows;
+    db::query(db, "SELECT name, description, value, is_global FROM text_commands;", text_command_rows);
+    for (auto& [name, description, value, global] : text_command_rows) {
+        db_text_commands.emplace(std::move(name), db_commands::text_command{std::move(description), std::move(value), global});
     }
     // Get DB embed command list
-    sqlite3_exec(db, "SELECT * FROM embed_commands;",
-        [](void* command_list, int column_count, char** column_values, char** column_names) -> int {
-            auto db_embed_commands = static_cast<std::unordered_map<std::string, db_commands::embed_command>*>(command_list);
-
-            db_commands::embed_command embed_command;
-            embed_command.description = std::string(column_values[1]);
-            embed_command.global = strcmp(column_values[2], "false");
-            embed_command.embed = dpp::embed();
-            if (column_values[3] != nullptr) embed_command.embed.set_title(column_values[3]);
-            if (column_values[4] != nullptr) embed_command.embed.set_url(column_values[4]);
-            if (column_values[5] != nullptr) embed_command.embed.set_description(column_values[5]);
-            if (column_values[6] != nullptr) embed_command.embed.set_thumbnail(column_values[6]);
-            if (column_values[7] != nullptr) embed_command.embed.set_image(column_values[7]);
-            if (column_values[8] != nullptr) embed_command.embed.set_video(column_values[8]);
-            if (column_values[9] != nullptr) {
-                embed_command.embed.set_color(std::strtoul(column_values[9], nullptr, 10));
-            }
-            if (column_values[10] != nullptr) {
-                embed_command.embed.set_timestamp(std::strtoll(column_values[10], nullptr, 10));
-            }
-            if (column_values[11] != nullptr || column_values[12] != nullptr || column_values[13] != nullptr) {
-                embed_command.embed.set_author(column_values[11], column_values[12], column_values[13]);
-            }
-            if (column_values[14] != nullptr || column_values[15] != nullptr) {
-                embed_command.embed.set_footer(column_values[14], column_values[15]);
-            }
-            if (column_values[16] != nullptr) {
-                // Nested DB query requires an inner function to avoid capturing sqlite's existing pointers
-                auto add_fields = [](const std::string &fields, db_commands::embed_command &embed_command) {
-                    // Open new DB connection to avoid messing with existing one
-                    sqlite3 *db;
-                    int status = sqlite3_open(DB_FILE.c_str(), &db);
-                    if (status != 0) {
-                        return;
-                    }
-                    // Execute query
-                    char* error_message;
-                    sqlite3_exec(db, std::format("SELECT * FROM embed_command_fields WHERE id IN ({});", fields).c_str(),
-                        [](void* command, int column_count, char** column_values, char** column_names) -> int {
-                            auto embed_command = static_cast<db_commands::embed_command*>(command);
-                            embed_command->embed.add_field(
-                                column_values[1], // field name
-                                column_values[2], // field value
-                                strcmp(column_values[3], "false")); // if field is inline or not
-                            return 0;
-                        },
-                    &embed_command, &error_message);
-                    if (error_message != nullptr) {
-                        util::log("SQL ERROR", error_message);
-                        sqlite3_free(error_message);
-                    }
-                    // Close new DB connection
-                    sqlite3_close(db);
-                };
-                add_fields(column_values[16], embed_command);
+    std::vector<std::tuple<std::string, std::string, bool,
+                           std::optional<std::string>, std::optional<std::string>, std::optional<std::string>,
+                           std::optional<std::string>, std::optional<std::string>, std::optional<std::string>,
+                           std::optional<uint32_t>, std::optional<time_t>,
+                           std::optional<std::string>, std::optional<std::string>, std::optional<std::string>,
+                           std::optional<std::string>, std::optional<std::string>, std::optional<std::string>>> embed_command_rows;
+    db::query(db, "SELECT * FROM embed_commands;", embed_command_rows);
+    for (const auto& [name, description, global, title, url, embed_description, thumbnail, image, video, color, timestamp,
+                      author_name, author_url, author_icon_url, footer_text, footer_icon_url, fields] : embed_command_rows) {
+        db_commands::embed_command embed_command;
+        embed_command.description = description;
+        embed_command.global = global;
+        embed_command.embed = dpp::embed();
+        if (title) embed_command.embed.set_title(*title);
+        if (url) embed_command.embed.set_url(*url);
+        if (embed_description) embed_command.embed.set_description(*embed_description);
+        if (thumbnail) embed_command.embed.set_thumbnail(*thumbnail);
+        if (image) embed_command.embed.set_image(*image);
+        if (video) embed_command.embed.set_video(*video);
+        if (color) embed_command.embed.set_color(*color);
+        if (timestamp) embed_command.embed.set_timestamp(*timestamp);
+        if (author_name || author_url || author_icon_url) {
+            embed_command.embed.set_author(author_name.value_or(""), author_url.value_or(""), author_icon_url.value_or(""));
+        }
+        if (footer_text || footer_icon_url) {
+            embed_command.embed.set_footer(footer_text.value_or(""), footer_icon_url.value_or(""));
+        }
+        if (fields) {
+            std::vector<std::tuple<std::string, std::string, bool>> field_rows;
+            db::query(db, std::format("SELECT title, value, is_inline FROM embed_command_fields WHERE id IN ({});", *fields), field_rows);
+            for (const auto& [field_title, field_value, is_inline] : field_rows) {
+                embed_command.embed.add_field(field_title, field_value, is_inline);
             }
-
-            db_embed_commands->emplace(column_values[0], embed_command);
-            return 0;
-        },
-    &db_embed_commands, &error_message);
-    if (error_message != nullptr) {
-        util::log("SQL ERROR", error_message);
-        sqlite3_free(error_message);
+        }
+        db_embed_commands.emplace(name, embed_command);
     }
+    // Index command names and IDs for autocomplete
+    autocomplete::start(db, db_text_commands, db_embed_commands);
 
     // Set bot token and intents, and enable logging
     uint32_t intents = dpp::i_default_intents + dpp::i_message_content + dpp::i_guild_members;
-    dpp::cluster bot(config["bot_token"], intents);
+    dpp::cluster bot((*config)["bot_token"], intents);
     bot.on_log([](const dpp::log_t& event) {
         if (event.severity >= dpp::ll_info) {
             util::log(dpp::utility::loglevel(event.severity), event.message);
         }
     });
-    // Keep track of bump timer
-    bool bump_timer_running = false;
 
-    bot.on_slashcommand([&config, &db_text_commands, &db_embed_commands, &db, &bump_timer_running](const dpp::slashcommand_t &event) -> dpp::task<> {
-        std::string command_name = event.command.get_command_name();
-        if (command_name == "add-text-command") db_commands::add_text_command_modal(event);
-        else if (command_name == "add-embed-command") co_await db_commands::add_embed_command(event, config, db_embed_commands, db);
-        else if (command_name == "add-embed-command-field") db_commands::add_embed_command_field_modal(event, db_embed_commands);
-        else if (command_name == "remove-embed-command-field") db_commands::remove_embed_command_field_menu(event, db_embed_commands, db);
-        else if (command_name == "edit-embed-command-field") db_commands::edit_embed_command_field_menu(event, db_embed_commands, db);
-        else if (command_name == "remove-db-command") co_await db_commands::remove_command(event, config, db_text_commands, db_embed_commands, db);
-        else if (command_name == "db-command-list") db_commands::get_commands(event, db_text_commands, db_embed_commands);
-        else if (command_name == "ping") meta::ping(event);
-        else if (command_name == "uptime") meta::uptime(event);
-        else if (command_name == "commit") meta::get_commit(event);
-        else if (command_name == "sendmessage") co_await meta::send_message(event);
-        else if (command_name == "announce") co_await meta::announce(event, config);
-        else if (command_name == "dm") co_await meta::dm(event, config);
-        else if (command_name == "remindme") meta::remindme(event, db);
-        else if (command_name == "set-bump-timer") meta::set_bump_timer(event, config, bump_timer_running);
-        else if (command_name == "appeal-respond") meta::appeal_respond(event, db);
-        else if (command_name == "application-respond") co_await meta::application_respond(event, config, db);
-        else if (command_name == "rules") server_info::rules(event, config);
-        else if (command_name == "rule") server_info::rule(event, config);
-        else if (command_name == "suggest") server_info::suggest(event, config);
-        else if (command_name == "suggestion-respond") co_await server_info::suggestion_response(event, config);
-        else if (command_name == "create-ticket") co_await moderation::create_ticket(event, config);
-        else if (command_name == "purge") co_await moderation::purge(event, config);
-        else if (command_name == "userinfo") moderation::userinfo(event, config);
-        else if (command_name == "inviteinfo") co_await moderation::inviteinfo(event);
-        else if (command_name == "warn") co_await moderation::warn(event, config, db);
-        else if (command_name == "unwarn") co_await moderation::unwarn(event, config, db);
-        else if (command_name == "mute") co_await moderation::mute(event, config, db);
-        else if (command_name == "unmute") co_await moderation::unmute(event, config, db);
-        else if (command_name == "kick") co_await moderation::kick(event, config, db);
-        else if (command_name == "ban") co_await moderation::ban(event, config, db);
-        else if (command_name == "unban") co_await moderation::unban(event, config, db);
-        else if (command_name == "warnings") moderation::get_mod_actions(event, db);
-        else {
+    bot.on_slashcommand([&db_text_commands, &db_embed_commands, &db](const dpp::slashcommand_t &event) -> dpp::task<> {
+        // Each command uses the config for the server it's run in. DMs use the main server's, and so do the
+        // global commands, which are the only ones in servers the bot isn't configured for.
+        std::shared_ptr<const settings::typed_config> typed_config;
+        settings::snapshot config = settings::config(event.command.guild_id, typed_config);
+        if (config == nullptr) {
+            config = settings::config(0, typed_config);
+        }
+        const std::string command_name = event.command.get_command_name();
+        // A partner server may still have one of these registered from before it was a partner
+        if (!typed_config->main_guild && std::ranges::find(MAIN_GUILD_COMMANDS, command_name) != MAIN_GUILD_COMMANDS.end()) {
+            event.reply(dpp::message("This command can only be used in the main server.").set_flags(dpp::m_ephemeral));
+            co_return;
+        }
+        if (const command_handler* handler = BUILTIN_COMMANDS.find(command_name); handler != nullptr) {
+            co_await (*handler)(event, command_context{*config, *typed_config, db, db_text_commands, db_embed_commands});
+        } else {
             auto text_command = db_text_commands.find(command_name);
             if (text_command != db_text_commands.end()) {
-                event.reply(text_command->second.value);
+                util::reply_cached(event, command_name, [&text_command] {
+                    return dpp::message(text_command->second.value);
+                });
             } else {
                 auto embed_command = db_embed_commands.find(command_name);
                 if (embed_command != db_embed_commands.end()) {
-                    event.reply(dpp::message(event.command.channel_id, embed_command->second.embed));
+                    util::reply_cached(event, command_name, [&embed_command] {
+                        return dpp::message(embed_command->second.embed);
+                    });
                 } else {
                     util::log("INFO", std::format("Command /{} does not exist.", command_name));
                 }
             }
         }
     });
+    bot.on_autocomplete([](const dpp::autocomplete_t &event) {
+        autocomplete::on_autocomplete(event);
+    });
     bot.on_select_click([&db_embed_commands, &db](const dpp::select_click_t &event) {
         if (event.custom_id == "remove_field_select") db_commands::remove_embed_command_field(event, db_embed_commands, db);
         else if (event.custom_id == "edit_field_select") db_commands::edit_embed_command_field_modal(event, db);
     });
-    bot.on_form_submit([&config, &db_text_commands, &db_embed_commands, &db](const dpp::form_submit_t &event) -> dpp::task<> {
-        if (event.custom_id == "add_text_command_form") co_await db_commands::add_text_command(event, config, db_text_commands, db);
+    bot.on_button_click([&db](const dpp::button_click_t &event) {
+        if (event.custom_id.substr(0, 13) == "warnings_page") {
+            const std::shared_ptr<const settings::typed_config> config = settings::typed(event.command.guild_id);
+            if (config == nullptr) return;
+            moderation::change_mod_actions_page(event, *config, db);
+        }
+    });
+    bot.on_form_submit([&db_text_commands, &db_embed_commands, &db](const dpp::form_submit_t &event) -> dpp::task<> {
+        const settings::snapshot config = settings::config();
+        if (event.custom_id == "add_text_command_form") co_await db_commands::add_text_command(event, *config, db_text_commands, db);
         else if (event.custom_id.substr(0, 14) == "add_field_form") db_commands::add_embed_command_field(event, db_embed_commands, db);
         else if (event.custom_id.substr(0, 15) == "edit_field_form") db_commands::edit_embed_command_field(event, db_embed_commands, db);
     });
 
-    // Caches for listeners
-    std::vector<dpp::automod_rule> automod_rules;
-    std::vector<dpp::invite> invites;
-    // Listeners
-    bot.on_automod_rule_create([&config, &automod_rules](const dpp::automod_rule_create_t &event) -> dpp::task<> {
-        co_await automod_rules::on_automod_rule_add(event, config, automod_rules);
+    // Set once slash commands have first been registered, after which reloading commands.json registers them again
+    std::atomic<bool> commands_registered = false;
+    // Caches for listeners, one for each server. The servers only change on restart, so the maps are filled in
+    // here and never modified while handlers are using them.
+    std::unordered_map<dpp::snowflake, std::vector<dpp::automod_rule>> automod_rules;
+    std::unordered_map<dpp::snowflake, std::vector<dpp::invite>> invites;
+    for (const dpp::snowflake guild_id : settings::guild_ids()) {
+        automod_rules.try_emplace(guild_id);
+        invites.try_emplace(guild_id);
+    }
+    // Listeners. Each uses the config for the server its event is from, and ignores servers it isn't configured for.
+    bot.on_automod_rule_create([&automod_rules](const dpp::automod_rule_create_t &event) -> dpp::task<> {
+        const settings::snapshot config = settings::config(event.created.guild_id);
+        if (config == nullptr) co_return;
+        co_await automod_rules::on_automod_rule_add(event, *config, automod_rules.at(event.created.guild_id));
     });
-    bot.on_automod_rule_delete([&config, &automod_rules](const dpp::automod_rule_delete_t &event) {
-        automod_rules::on_automod_rule_remove(event, config, automod_rules);
+    bot.on_automod_rule_delete([&automod_rules](const dpp::automod_rule_delete_t &event) {
+        const settings::snapshot config = settings::config(event.deleted.guild_id);
+        if (config == nullptr) return;
+        automod_rules::on_automod_rule_remove(event, *config, automod_rules.at(event.deleted.guild_id));
     });
-    bot.on_automod_rule_update([&config, &automod_rules](const dpp::automod_rule_update_t &event) {
-        automod_rules::on_automod_rule_edit(event, config, automod_rules);
+    bot.on_automod_rule_update([&automod_rules](const dpp::automod_rule_update_t &event) {
+        const settings::snapshot config = settings::config(event.updated.guild_id);
+        if (config == nullptr) return;
+        automod_rules::on_automod_rule_edit(event, *config, automod_rules.at(event.updated.guild_id));
     });
-    bot.on_message_create([&config, &bump_timer_running](const dpp::message_create_t &event) {
-        messages::on_message(event, config, bump_timer_running);
+    bot.on_message_create([&db](const dpp::message_create_t &event) {
+        // DMs have no server, and use the main server's config
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(event.msg.guild_id);
+        if (config == nullptr) return;
+        messages::on_message(event, *config, db);
     });
-    bot.on_message_delete([&config](const dpp::message_delete_t &event) -> dpp::task<> {
-        co_await messages::on_message_deleted(event, config);
+    bot.on_message_delete([](const dpp::message_delete_t &event) -> dpp::task<> {
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(event.guild_id);
+        if (config == nullptr) co_return;
+        co_await messages::on_message_deleted(event, *config);
     });
-    bot.on_message_update([&config](const dpp::message_update_t &event) -> dpp::task<> {
-        co_await messages::on_message_edited(event, config);
+    bot.on_message_update([](const dpp::message_update_t &event) -> dpp::task<> {
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(event.msg.guild_id);
+        if (config == nullptr) co_return;
+        co_await messages::on_message_edited(event, *config);
     });
-    bot.on_message_reaction_add([&config](const dpp::message_reaction_add_t &event) -> dpp::task<> {
-        co_await messages::on_reaction(event, config);
+    bot.on_message_reaction_add([](const dpp::message_reaction_add_t &event) -> dpp::task<> {
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(event.reacting_guild.id);
+        if (config == nullptr) co_return;
+        co_await messages::on_reaction(event, *config);
     });
-    bot.on_message_reaction_remove([&config](const dpp::message_reaction_remove_t &event) -> dpp::task<> {
-        co_await messages::on_reaction_removed(event, config);
+    bot.on_message_reaction_remove([](const dpp::message_reaction_remove_t &event) -> dpp::task<> {
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(event.reacting_guild.id);
+        if (config == nullptr) co_return;
+        co_await messages::on_reaction_removed(event, *config);
     });
-    bot.on_guild_audit_log_entry_create([&config](const dpp::guild_audit_log_entry_create_t &event) -> dpp::task<> {
+    bot.on_guild_audit_log_entry_create([](const dpp::guild_audit_log_entry_create_t &event) -> dpp::task<> {
         if (event.entry.user_id == event.owner->me.id) {
             co_return;
         }
+        // D++ doesn't say which server an audit log entry is from, so it's read from the raw event
+        const nlohmann::json raw_event = nlohmann::json::parse(event.raw_event, nullptr, false);
+        if (raw_event.is_discarded() || !raw_event.contains("d") || !raw_event["d"].contains("guild_id")) {
+            co_return;
+        }
+        const settings::snapshot config = settings::config(dpp::snowflake(raw_event["d"]["guild_id"].get<std::string>()));
+        if (config == nullptr) co_return;
         switch (event.entry.type) {
             case dpp::aut_member_kick:
-                co_await members::on_kick(event, config);
+                co_await members::on_kick(event, *config);
                 break;
             case dpp::aut_member_ban_add:
-                co_await members::on_ban(event, config);
+                co_await members::on_ban(event, *config);
                 break;
             case dpp::aut_member_ban_remove:
-                co_await members::on_unban(event, config);
+                co_await members::on_unban(event, *config);
                 break;
             case dpp::aut_member_update:
-                co_await members::on_member_edit(event, config);
+                co_await members::on_member_edit(event, *config);
                 break;
             case dpp::aut_member_role_update:
-                co_await members::on_roles_change(event, config);
+                co_await members::on_roles_change(event, *config);
                 break;
             default:
                 break;
         }
     });
-    bot.on_guild_join_request_delete([&config](const dpp::guild_join_request_delete_t &event) -> dpp::task<> {
-        co_await members::on_sus_join(event, config);
+    bot.on_guild_join_request_delete([](const dpp::guild_join_request_delete_t &event) -> dpp::task<> {
+        const settings::snapshot config = settings::config(event.guild_id);
+        if (config == nullptr) co_return;
+        co_await members::on_sus_join(event, *config);
+    });
+    bot.on_guild_member_add([&invites](const dpp::guild_member_add_t &event) -> dpp::task<> {
+        const settings::snapshot config = settings::config(event.adding_guild.id);
+        if (config == nullptr) co_return;
+        util::index_member(event.added);
+        co_await members::on_join(event, *config, invites.at(event.adding_guild.id));
     });
-    bot.on_guild_member_add([&config, &invites](const dpp::guild_member_add_t &event) -> dpp::task<> {
-        co_await members::on_join(event, config, invites);
+    bot.on_guild_member_update([](const dpp::guild_member_update_t &event) {
+        if (settings::config(event.updated.guild_id) == nullptr) return;
+        util::index_member(event.updated);
     });
-    bot.on_guild_member_remove([&config](const dpp::guild_member_remove_t &event) {
-        members::on_leave(event, config);
+    bot.on_guild_member_remove([](const dpp::guild_member_remove_t &event) {
+        const settings::snapshot config = settings::config(event.guild_id);
+        if (config == nullptr) return;
+        util::unindex_member(event.guild_id, event.removed.id);
+        members::on_leave(event, *config);
     });
-    bot.on_invite_create([&config, &invites](const dpp::invite_create_t &event) {
-        guild::on_invite_created(event, config, invites);
+    bot.on_guild_members_chunk([](const dpp::guild_members_chunk_t &event) {
+        // D++ asks for every member of each server when it connects, since the bot has the server members intent.
+        // The chunks are read from the raw event, which also says which chunk each one is.
+        const nlohmann::json raw_event = nlohmann::json::parse(event.raw_event, nullptr, false);
+        if (raw_event.is_discarded() || !raw_event.contains("d")) return;
+        const nlohmann::json& chunk = raw_event["d"];
+        if (settings::config(dpp::snowflake(chunk["guild_id"].get<std::string>())) == nullptr) return;
+        util::index_member_chunk(chunk);
     });
-    bot.on_invite_delete([&config, &invites](const dpp::invite_delete_t &event) {
-        guild::on_invite_deleted(event, config, invites);
+    bot.on_invite_create([&invites](const dpp::invite_create_t &event) {
+        const settings::snapshot config = settings::config(event.created_invite.guild_id);
+        if (config == nullptr) return;
+        guild::on_invite_created(event, *config, invites.at(event.created_invite.guild_id));
+    });
+    bot.on_invite_delete([&invites](const dpp::invite_delete_t &event) {
+        const settings::snapshot config = settings::config(event.deleted_invite.guild_id);
+        if (config == nullptr) return;
+        guild::on_invite_deleted(event, *config, invites.at(event.deleted_invite.guild_id));
     });
 
-    // TODO: Autodetect bump timer on bot restart?
-    bot.on_ready([&config, &commands, &db, &db_text_commands, &db_embed_commands, &automod_rules, &invites](const dpp::ready_t &event) -> dpp::task<> {
+    bot.on_ready([&commands_registered, &db, &automod_rules, &invites](const dpp::ready_t &event) -> dpp::task<> {
         if (dpp::run_once<struct register_bot_commands>()) {
-            std::vector<dpp::slashcommand> global_commands;
-            std::vector<dpp::slashcommand> tsc_commands;
-            for (auto &category : commands) {
-                for (auto &command : category) {
-                    dpp::slashcommand slash_command(
-                        command["name"].get<std::string>(),
-                        command["description"].get<std::string>(),
-                        event.owner->me.id
-                    );
-
-                    for (auto &option : command["options"]) {
-                        dpp::command_option command_option(
-                            option["type"],
-                            option["name"],
-                            option["description"],
-                            option["required"]
-                        );
-                        if (option["min_value"] != nullptr) {
-                            command_option.set_min_value(option["min_value"].get<int64_t>());
-                        }
-                        if (option["max_value"] != nullptr) {
-                            command_option.set_max_value(option["max_value"].get<int64_t>());
-                        }
-                        if (option["min_length"] != nullptr) {
-                            command_option.set_min_length(option["min_length"].get<int64_t>());
-                        }
-                        if (option["max_length"] != nullptr) {
-                            command_option.set_max_length(option["max_length"].get<int64_t>());
-                        }
-                        slash_command.add_option(command_option);
-                    }
-
-                    switch (command["permission_level"].get<util::command_perms>()) {
-                        case util::ADMIN_ONLY:
-                            // Only admins can use the command
-                            slash_command.set_default_permissions(dpp::permissions::p_administrator);
-                            tsc_commands.push_back(slash_command);
-                            break;
-                        case util::MOD_ONLY:
-                            // Only users who can see the audit log (moderators) can use the command
-                            slash_command.set_default_permissions(dpp::permissions::p_view_audit_log);
-                            tsc_commands.push_back(slash_command);
-                            break;
-                        case util::TRIAL_MOD_ONLY:
-                            // Only users with manage messages (trial mods and mods) can use the command
-                            slash_command.set_default_permissions(dpp::permissions::p_manage_messages);
-                            tsc_commands.push_back(slash_command);
-                            break;
-                        case util::STAFF_ONLY:
-                            // Only users who can change their own nickname (staff) can use the command
-                            slash_command.set_default_permissions(dpp::permissions::p_change_nickname);
-                            tsc_commands.push_back(slash_command);
-                            break;
-                        case util::GLOBAL:
-                            // This command can be run by anyone, and it can be run anywhere including DMs
-                            slash_command.set_dm_permission(true);
-                            global_commands.push_back(slash_command);
-                            break;
-                        case util::SERVER_ONLY:
-                        default:
-                            // Default: This command can be run by anyone, but only within the server
-                            tsc_commands.push_back(slash_command);
-                            break;
-                    }
-                }
+            // Set first, so a reload from here on registers again rather than being missed
+            commands_registered = true;
+            if (!register_commands(event.owner, db)) {
+                util::log("ERROR", "Failed to get DB commands, so no commands were registered");
             }
-            for (const auto& [name, command] : db_text_commands) {
-                dpp::slashcommand slash_command(name, command.description, event.owner->me.id);
-                if (command.global) {
-                    slash_command.set_dm_permission(true);
-                    global_commands.push_back(slash_command);
-                } else {
-                    tsc_commands.push_back(slash_command);
-                }
-            }
-            for (const auto& [name, command] : db_embed_commands) {
-                dpp::slashcommand slash_command(name, command.description, event.owner->me.id);
-                if (command.global) {
-                    slash_command.set_dm_permission(true);
-                    global_commands.push_back(slash_command);
-                } else {
-                    tsc_commands.push_back(slash_command);
-                }
-            }
-            event.owner->global_bulk_command_create(global_commands);
-            event.owner->guild_bulk_command_create(tsc_commands, config["guild_id"]);
         }
         event.owner->set_presence(dpp::presence(dpp::ps_online, dpp::at_watching, "TSC"));
 
-        // Resume remaining reminders
-        std::vector<util::reminder> reminder_list;
-        char* error_message;
-        sqlite3_exec(db, "SELECT id, start_time, end_time, user, text FROM reminders;",
-            [](void* reminder_list, int column_count, char** column_values, char** column_names) -> int {
-                auto reminders = static_cast<std::vector<util::reminder>*>(reminder_list);
-                util::reminder reminder;
-                reminder.id = strtoll(column_values[0], nullptr, 10);
-                reminder.start_time = strtoll(column_values[1], nullptr, 10);
-                reminder.end_time = strtoll(column_values[2], nullptr, 10);
-                reminder.user = strtoull(column_values[3], nullptr, 10);
-                reminder.text = column_values[4];
-                reminders->push_back(reminder);
-                return 0;
-            },
-        &reminder_list, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
-        }
-        for (const util::reminder& reminder : reminder_list) {
-            std::string log_message;
-            if (reminder.end_time < time(nullptr)) {
-                log_message += "Belated";
-            } else {
-                log_message += "Resuming";
-            }
-            log_message += " reminder of " + util::seconds_to_fancytime(reminder.end_time - reminder.start_time, 4);
-            if (const dpp::user* user = dpp::find_user(reminder.user); user != nullptr) {
-                log_message += " from " + user->username;
-            }
-            util::log("INFO", log_message);
-            util::remind(event.owner, db, reminder);
+        // Schedule the reminders and mutes due soon, and keep loading later ones as they get close.
+        // Also pick up the bump timers that were running when the bot last stopped.
+        if (dpp::run_once<struct start_schedule_window>()) {
+            util::start_schedule_window(event.owner, db);
+            util::resume_bump_timers(event.owner, db);
         }
 
-        // Resume remaining mutes
-        std::vector<util::mute> mute_list;
-        sqlite3_exec(db, "SELECT user, extra_data FROM mod_records WHERE type='mute' AND active='true';",
-            [](void* mute_list, int column_count, char** column_values, char** column_names) -> int {
-                auto mutes = static_cast<std::vector<util::mute>*>(mute_list);
-                util::mute mute;
-                mute.user = strtoull(column_values[0], nullptr, 10);
-                mute.id = strtoll(column_values[1], nullptr, 10);
-                mutes->push_back(mute);
-                return 0;
-            },
-        &mute_list, &error_message);
-        if (error_message != nullptr) {
-            util::log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
-        }
-        for (util::mute& mute : mute_list) {
-            sqlite3_exec(db, std::format("SELECT start_time, end_time FROM mutes WHERE id={};", mute.id).c_str(),
-                [](void* output, int column_count, char** column_values, char** column_names) -> int {
-                    auto mute = static_cast<util::mute*>(output);
-                    mute->start_time = strtoll(column_values[0], nullptr, 10);
-                    mute->end_time = strtoll(column_values[1], nullptr, 10);
-                    return 0;
-                },
-            &mute, &error_message);
-            if (error_message != nullptr) {
-                util::log("SQL ERROR", error_message);
-                sqlite3_free(error_message);
-                mute.start_time = time(nullptr);
-                mute.end_time = mute.start_time;
-            }
-
-            std::string log_message;
-            if (mute.end_time < time(nullptr)) {
-                log_message += "Belated removal of";
-            } else {
-                log_message += "Resuming";
+        for (const dpp::snowflake guild_id : settings::guild_ids()) {
+            // Add all automod rules to cache
+            dpp::confirmation_callback_t rule_conf = co_await event.owner->co_automod_rules_get(guild_id);
+            if (!rule_conf.is_error()) {
+                for (const dpp::automod_rule& rule : std::get<dpp::automod_rule_map>(rule_conf.value) | std::views::values) {
+                    automod_rules.at(guild_id).push_back(rule);
+                }
             }
-            log_message += " mute of " + util::seconds_to_fancytime(mute.end_time - mute.start_time, 4);
-            if (const dpp::user* user = dpp::find_user(mute.user); user != nullptr) {
-                log_message += " from " + user->username;
+            // Add all invites to cache
+            dpp::confirmation_callback_t invite_conf = co_await event.owner->co_guild_get_invites(guild_id);
+            if (!invite_conf.is_error()) {
+                for (const dpp::invite& invite : std::get<dpp::invite_map>(invite_conf.value) | std::views::values) {
+                    invites.at(guild_id).push_back(invite);
+                }
             }
-            util::log("INFO", log_message);
-            util::handle_mute(event.owner, db, config, mute);
         }
+    });
 
-        // Add all automod rules to cache
-        dpp::confirmation_callback_t rule_conf = co_await event.owner->co_automod_rules_get(config["guild_id"]);
-        if (!rule_conf.is_error()) {
-            for (const dpp::automod_rule& rule : std::get<dpp::automod_rule_map>(rule_conf.value) | std::views::values) {
-                automod_rules.push_back(rule);
-            }
+    // Apply changes to config.json and commands.json without restarting
+    std::jthread settings_thread = settings::watch(DATA_PATH, [&bot, &db, &commands_registered](const bool config_changed, const bool commands_changed) {
+        if (config_changed) {
+            // Cached replies such as the rules are built from the config, and so are members' staff roles
+            util::clear_reply_cache();
+            util::reindex_staff();
         }
-        // Add all invites to cache
-        dpp::confirmation_callback_t invite_conf = co_await event.owner->co_guild_get_invites(config["guild_id"]);
-        if (!invite_conf.is_error()) {
-            for (const dpp::invite& invite : std::get<dpp::invite_map>(invite_conf.value) | std::views::values) {
-                invites.push_back(invite);
+        // Changes before the first registration are picked up by it
+        if (commands_changed && commands_registered) {
+            if (!register_commands(&bot, db)) {
+                util::log("ERROR", "Failed to get DB commands, so changes to commands.json weren't registered");
             }
         }
     });
 
     bot.start(dpp::st_wait);
+    // Abandon any backup or archiving in progress, and stop timers and reloads, before closing the DB they use
+    for (std::jthread* thread : {&settings_thread, &backup_thread, &archive_thread, &scheduler_thread}) {
+        thread->request_stop();
+        if (thread->joinable()) {
+            thread->join();
+        }
+    }
     sqlite3_close(db);
 }
\ No newline at end of file
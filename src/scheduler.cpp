@@ -0,0 +1,69 @@
+/* scheduler: Timers for reminders, mutes, and other delayed actions
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "scheduler.h"
+#include "util.h"
+#include <condition_variable>
+#include <mutex>
+
+static std::mutex wheel_mutex; /**< Guards wheel */
+static scheduler::timing_wheel wheel; /**< Pending timers, one tick per second */
+static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now(); /**< Time of tick 0 */
+
+/**
+ * @return Number of whole seconds since tick 0 on the monotonic clock
+ */
+static uint64_t elapsed_ticks() {
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+std::jthread scheduler::start() {
+    return std::jthread([](const std::stop_token& stop) {
+        std::vector<std::function<void()>> due;
+        std::mutex sleep_mutex;
+        std::unique_lock sleep_lock(sleep_mutex);
+        std::condition_variable_any sleeper;
+        do {
+            {
+                std::lock_guard lock(wheel_mutex);
+                // Also processes any ticks that passed while earlier callbacks were running
+                wheel.advance(elapsed_ticks(), due);
+            }
+            // Run callbacks without the lock so they can schedule and cancel timers
+            for (std::function<void()>& callback : due) {
+                try {
+                    callback();
+                } catch (const std::exception& e) {
+                    util::log("ERROR", std::string("Scheduled callback failed: ") + e.what());
+                }
+            }
+            due.clear();
+            // Sleep until the start of the next tick, waking early only to stop
+            sleeper.wait_until(sleep_lock, stop, epoch + std::chrono::seconds(elapsed_ticks() + 1), []{return false;});
+        } while (!stop.stop_requested());
+    });
+}
+
+uint64_t scheduler::schedule(const time_t when, std::function<void()> callback) {
+    const time_t delay = std::max<time_t>(when - time(nullptr), 0);
+    // Round up, so the callback never runs before the full delay has passed
+    const uint64_t deadline = elapsed_ticks() + delay + 1;
+    std::lock_guard lock(wheel_mutex);
+    return wheel.schedule(deadline, std::move(callback));
+}
+
+bool scheduler::cancel(const uint64_t id) {
+    std::lock_guard lock(wheel_mutex);
+    return wheel.cancel(id);
+}
@@ -0,0 +1,162 @@
+/* scheduler: Timers for reminders, mutes, and other delayed actions
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace scheduler {
+    /**
+     * Hierarchical timing wheel of callbacks, each due at a tick.
+     * Every level has 64 slots, and each slot of a level spans all 64 slots of the level below it. Timers are put
+     * in the lowest level whose range reaches their deadline, and move down a level each time the level above
+     * comes around to their slot, so scheduling and cancelling are O(1) and a tick only touches one slot per
+     * level no matter how many timers are pending. Not thread-safe on its own.
+     */
+    class timing_wheel {
+        static constexpr unsigned int SLOT_BITS = 6; /**< log2 of the number of slots per level */
+        static constexpr uint64_t SLOTS = 1 << SLOT_BITS; /**< Number of slots per level */
+        static constexpr unsigned int LEVELS = 5; /**< Number of levels, covering 2^30 ticks (34 years of seconds) */
+
+        /**
+         * A pending callback
+         */
+        struct timer {
+            uint64_t deadline; /**< Tick the callback is due at */
+            std::function<void()> callback; /**< Function to call when due */
+        };
+
+        std::unordered_map<uint64_t, timer> timers; /**< Pending timers by ID */
+        std::array<std::array<std::vector<uint64_t>, SLOTS>, LEVELS> slots; /**< Timer IDs in each slot, including cancelled ones */
+        uint64_t current_tick = 0; /**< Next tick to be processed */
+        uint64_t next_id = 1; /**< ID to give the next timer */
+
+        /**
+         * Put a timer in the slot for its deadline
+         * @param id ID of the timer
+         * @param deadline Tick the timer is due at
+         */
+        void place(const uint64_t id, uint64_t deadline) {
+            // Overdue timers go in the current slot, and ones beyond the top level wait in its farthest slot
+            deadline = std::clamp<uint64_t>(deadline, current_tick, current_tick + (1ULL << (SLOT_BITS * LEVELS)) - 1);
+            const uint64_t delta = deadline - current_tick;
+            unsigned int level = 0;
+            while (level + 1 < LEVELS && delta >= 1ULL << (SLOT_BITS * (level + 1))) {
+                level++;
+            }
+            slots[level][(deadline >> (SLOT_BITS * level)) & (SLOTS - 1)].push_back(id);
+        }
+
+        public:
+            /**
+             * Add a timer
+             * @param deadline Tick to call the callback at. Ticks that have already passed are treated as the current tick.
+             * @param callback Function to call when due
+             * @return ID of the timer, for cancelling it
+             */
+            uint64_t schedule(const uint64_t deadline, std::function<void()> callback) {
+                const uint64_t id = next_id++;
+                timers.emplace(id, timer{deadline, std::move(callback)});
+                place(id, deadline);
+                return id;
+            }
+
+            /**
+             * Remove a timer before it's due
+             * @param id ID from schedule
+             * @return true if the timer was pending
+             */
+            bool cancel(const uint64_t id) {
+                // The ID is left in its slot and skipped when the slot is reached
+                return timers.erase(id) != 0;
+            }
+
+            /**
+             * @return Number of pending timers
+             */
+            [[nodiscard]] size_t size() const {
+                return timers.size();
+            }
+
+            /**
+             * @return Next tick to be processed
+             */
+            [[nodiscard]] uint64_t tick() const {
+                return current_tick;
+            }
+
+            /**
+             * Process every tick up to and including a given one, collecting the callbacks that came due
+             * @param target Last tick to process
+             * @param due Vector to append the due callbacks to, in deadline order
+             */
+            void advance(const uint64_t target, std::vector<std::function<void()>>& due) {
+                for (; current_tick <= target; current_tick++) {
+                    // When a level wraps around, spread the next slot of the level above into the levels below
+                    for (unsigned int level = 1; level < LEVELS && (current_tick & ((1ULL << (SLOT_BITS * level)) - 1)) == 0; level++) {
+                        std::vector<uint64_t> cascading;
+                        cascading.swap(slots[level][(current_tick >> (SLOT_BITS * level)) & (SLOTS - 1)]);
+                        for (const uint64_t id : cascading) {
+                            if (auto it = timers.find(id); it != timers.end()) {
+                                place(id, it->second.deadline);
+                            }
+                        }
+                    }
+                    std::vector<uint64_t> expiring;
+                    expiring.swap(slots[0][current_tick & (SLOTS - 1)]);
+                    for (const uint64_t id : expiring) {
+                        auto it = timers.find(id);
+                        if (it == timers.end()) {
+                            continue;
+                        }
+                        // Timers parked past the top level aren't due yet
+                        if (it->second.deadline > current_tick) {
+                            place(id, it->second.deadline);
+                            continue;
+                        }
+                        due.push_back(std::move(it->second.callback));
+                        timers.erase(it);
+                    }
+                }
+            }
+    };
+
+    /**
+     * Start the thread that runs scheduled callbacks, ticking once a second on the monotonic clock
+     * @return Thread running the scheduler, which stops when it's destroyed or requested to stop
+     */
+    std::jthread start();
+
+    /**
+     * Call a function at a given time. Callbacks run on the scheduler thread, so they shouldn't block for long.
+     * The delay is measured on the monotonic clock from now, so changes to the system clock don't move the timer.
+     * @param when Unix time to call the function at, or as soon as possible if it has passed
+     * @param callback Function to call
+     * @return ID of the timer, for cancelling it
+     */
+    uint64_t schedule(time_t when, std::function<void()> callback);
+
+    /**
+     * Cancel a scheduled call
+     * @param id ID from schedule
+     * @return true if the call was still pending
+     */
+    bool cancel(uint64_t id);
+}
@@ -0,0 +1,536 @@
+/* settings: Live-reloadable config.json and commands.json
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "settings.h"
+#include "util.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+/**
+ * Config for one server, along with its typed settings
+ */
+struct guild_config {
+    nlohmann::json json; /**< Config data for the server */
+    settings::typed_config typed; /**< Settings resolved from json */
+};
+
+/**
+ * Config for every server, swapped as one so the JSON and typed settings always match
+ */
+struct config_data {
+    nlohmann::json json; /**< Parsed config.json */
+    std::vector<guild_config> guilds; /**< Config for each server, with the main server first */
+};
+
+static std::atomic<std::shared_ptr<const config_data>> current_config; /**< Config in use, swapped whole on reload */
+static std::atomic<settings::snapshot> current_commands; /**< Command list in use, swapped whole on reload */
+
+/**
+ * Settings that must be present in config.json, and the type each must have
+ */
+static const std::vector<std::pair<std::string, bool (nlohmann::json::*)() const noexcept>> REQUIRED_CONFIG = {
+    {"bot_token", &nlohmann::json::is_string},
+    {"guild_id", &nlohmann::json::is_number_unsigned},
+    {"role_ids", &nlohmann::json::is_object},
+    {"public_channel_ids", &nlohmann::json::is_object},
+    {"support_channel_ids", &nlohmann::json::is_object},
+    {"log_channel_ids", &nlohmann::json::is_object},
+    {"listen_message_ids", &nlohmann::json::is_object},
+    {"disboard_bot_id", &nlohmann::json::is_number_unsigned},
+    {"topgg_invite_code", &nlohmann::json::is_string},
+    {"ticket_auto_archive_mins", &nlohmann::json::is_number_unsigned},
+    {"slow_query_ms", &nlohmann::json::is_number_unsigned},
+    {"mute_backend", &nlohmann::json::is_string},
+    {"schedule_window_minutes", &nlohmann::json::is_number_unsigned},
+    {"autocomplete_refresh_seconds", &nlohmann::json::is_number_unsigned},
+    {"rules", &nlohmann::json::is_array}
+};
+
+/**
+ * Settings that the "backup" section must have if it's present, and the type each must have
+ */
+static const std::vector<std::pair<std::string, bool (nlohmann::json::*)() const noexcept>> BACKUP_CONFIG = {
+    {"directory", &nlohmann::json::is_string},
+    {"interval_hours", &nlohmann::json::is_number_unsigned},
+    {"retention", &nlohmann::json::is_number_unsigned},
+    {"pages_per_step", &nlohmann::json::is_number_unsigned},
+    {"step_delay_ms", &nlohmann::json::is_number_unsigned}
+};
+
+/**
+ * Settings that the "archive" section must have if it's present, and the type each must have
+ */
+static const std::vector<std::pair<std::string, bool (nlohmann::json::*)() const noexcept>> ARCHIVE_CONFIG = {
+    {"file", &nlohmann::json::is_string},
+    {"max_age_days", &nlohmann::json::is_number_unsigned},
+    {"interval_hours", &nlohmann::json::is_number_unsigned},
+    {"batch_size", &nlohmann::json::is_number_unsigned},
+    {"batch_delay_ms", &nlohmann::json::is_number_unsigned}
+};
+
+/**
+ * Settings that identify a server, which a partner server's config block must all give
+ * so that nothing meant for it is ever sent to the main server
+ */
+static const std::vector<std::string> GUILD_CONFIG = {
+    "guild_id", "role_ids", "public_channel_ids", "support_channel_ids", "log_channel_ids", "listen_message_ids"
+};
+
+/**
+ * Check that config data has every setting the bot reads, with the right types
+ * @param config Config data to check
+ * @return Description of the first problem found, or an empty string if it's valid
+ */
+static std::string validate_config(const nlohmann::json& config) {
+    if (!config.is_object()) {
+        return "not a JSON object";
+    }
+    for (const auto& [key, has_type] : REQUIRED_CONFIG) {
+        if (!config.contains(key)) {
+            return std::format("missing \"{}\"", key);
+        }
+        if (!(config[key].*has_type)()) {
+            return std::format("\"{}\" has the wrong type", key);
+        }
+    }
+    // The ID lists are all read as snowflakes
+    for (const char* key : {"role_ids", "public_channel_ids", "support_channel_ids", "log_channel_ids", "listen_message_ids"}) {
+        for (const auto& [name, id] : config[key].items()) {
+            if (!id.is_number_unsigned()) {
+                return std::format("\"{}\" in \"{}\" is not an ID", name, key);
+            }
+        }
+    }
+    for (const nlohmann::json& rule : config["rules"]) {
+        if (!rule.is_string()) {
+            return "\"rules\" has a rule that isn't a string";
+        }
+    }
+    if (config.contains("backup")) {
+        if (!config["backup"].is_object()) {
+            return "\"backup\" is not a JSON object";
+        }
+        for (const auto& [key, has_type] : BACKUP_CONFIG) {
+            if (!config["backup"].contains(key)) {
+                return std::format("\"backup\" is missing \"{}\"", key);
+            }
+            if (!(config["backup"][key].*has_type)()) {
+                return std::format("\"{}\" in \"backup\" has the wrong type", key);
+            }
+        }
+        // With any of these at 0, the backup thread would spin, never copy anything or delete every backup it makes
+        for (const char* key : {"interval_hours", "retention", "pages_per_step"}) {
+            if (config["backup"][key] == 0) {
+                return std::format("\"{}\" in \"backup\" must be at least 1", key);
+            }
+        }
+    }
+    if (config.contains("archive")) {
+        if (!config["archive"].is_object()) {
+            return "\"archive\" is not a JSON object";
+        }
+        for (const auto& [key, has_type] : ARCHIVE_CONFIG) {
+            if (!config["archive"].contains(key)) {
+                return std::format("\"archive\" is missing \"{}\"", key);
+            }
+            if (!(config["archive"][key].*has_type)()) {
+                return std::format("\"{}\" in \"archive\" has the wrong type", key);
+            }
+        }
+        // A batch size of 0 never moves anything but always looks like a full batch, so it would loop forever
+        for (const char* key : {"interval_hours", "batch_size"}) {
+            if (config["archive"][key] == 0) {
+                return std::format("\"{}\" in \"archive\" must be at least 1", key);
+            }
+        }
+    }
+    if (config.contains("partner_guilds")) {
+        if (!config["partner_guilds"].is_array()) {
+            return "\"partner_guilds\" is not a list";
+        }
+        for (const nlohmann::json& guild : config["partner_guilds"]) {
+            if (!guild.is_object()) {
+                return "\"partner_guilds\" has a server that isn't a JSON object";
+            }
+            for (const std::string& key : GUILD_CONFIG) {
+                if (!guild.contains(key)) {
+                    return std::format("a server in \"partner_guilds\" is missing \"{}\"", key);
+                }
+            }
+        }
+    }
+    return "";
+}
+
+/**
+ * Resolve the settings in typed_config from config data
+ * @param config Config data, already checked by validate_config
+ * @param typed Set to the resolved settings
+ * @return Description of the first setting that's missing, or an empty string if they're all there
+ */
+static std::string resolve_config(const nlohmann::json& config, settings::typed_config& typed) {
+    // validate_config has checked that every ID is a number, so only whether each is there needs checking
+    std::string missing;
+    auto id = [&config, &missing](const char* list, const char* key) -> dpp::snowflake {
+        if (!config[list].contains(key)) {
+            if (missing.empty()) {
+                missing = std::format("missing \"{}\" in \"{}\"", key, list);
+            }
+            return 0;
+        }
+        return config[list][key].get<uint64_t>();
+    };
+    typed.guild_id = config["guild_id"].get<uint64_t>();
+    typed.disboard_bot_id = config["disboard_bot_id"].get<uint64_t>();
+    typed.ticket_auto_archive_mins = config["ticket_auto_archive_mins"].get<uint32_t>();
+    typed.public_channel_ids.clear();
+    for (const nlohmann::json& channel : config["public_channel_ids"]) {
+        typed.public_channel_ids.emplace_back(channel.get<uint64_t>());
+    }
+    std::ranges::sort(typed.public_channel_ids);
+    typed.role_ids.owner = id("role_ids", "owner");
+    typed.role_ids.moderator = id("role_ids", "moderator");
+    typed.role_ids.trial_mod = id("role_ids", "trial_mod");
+    typed.role_ids.support_team = id("role_ids", "support_team");
+    typed.role_ids.bump_reminder = id("role_ids", "bump_reminder");
+    typed.role_ids.muted = id("role_ids", "muted");
+    typed.support_channel_ids.general_support = id("support_channel_ids", "general_support");
+    typed.log_channel_ids.tickets = id("log_channel_ids", "tickets");
+    typed.log_channel_ids.message_edited = id("log_channel_ids", "message_edited");
+    typed.log_channel_ids.message_deleted = id("log_channel_ids", "message_deleted");
+    typed.log_channel_ids.bot_dm = id("log_channel_ids", "bot_dm");
+    typed.listen_message_ids.bump_reminders = id("listen_message_ids", "bump_reminders");
+    typed.listen_message_ids.ticket_create = id("listen_message_ids", "ticket_create");
+    return missing;
+}
+
+/**
+ * Resolve the config for each server. A partner server's block replaces the main server's settings it gives,
+ * and the rest are shared with the main server.
+ * @param config Config data, already checked by validate_config
+ * @param guilds Set to the config for each server, with the main server first
+ * @return Description of the first problem found, or an empty string if there are none
+ */
+static std::string resolve_guilds(const nlohmann::json& config, std::vector<guild_config>& guilds) {
+    nlohmann::json main_config = config;
+    main_config.erase("partner_guilds");
+    guilds.clear();
+    guilds.push_back({main_config, {}});
+    if (const std::string problem = resolve_config(guilds[0].json, guilds[0].typed); !problem.empty()) {
+        return problem;
+    }
+    guilds[0].typed.main_guild = true;
+    for (const nlohmann::json& block : config.value("partner_guilds", nlohmann::json::array())) {
+        nlohmann::json merged = main_config;
+        merged.update(block);
+        std::string problem = validate_config(merged);
+        guild_config& guild = guilds.emplace_back(std::move(merged), settings::typed_config{});
+        if (problem.empty()) {
+            problem = resolve_config(guild.json, guild.typed);
+        }
+        if (!problem.empty()) {
+            return std::format("partner server {}", problem);
+        }
+        for (size_t i = 0; i < guilds.size() - 1; i++) {
+            if (guilds[i].typed.guild_id == guild.typed.guild_id) {
+                return std::format("server {} is configured more than once", guild.typed.guild_id.str());
+            }
+        }
+    }
+    return "";
+}
+
+/**
+ * Find a server's config
+ * @param config Config for every server
+ * @param guild_id ID of the server, or 0 for the main server
+ * @return The server's config, or nullptr if the bot isn't configured for it
+ */
+static const guild_config* find_guild(const config_data& config, const dpp::snowflake guild_id) {
+    if (guild_id == 0) {
+        return &config.guilds[0];
+    }
+    for (const guild_config& guild : config.guilds) {
+        if (guild.typed.guild_id == guild_id) {
+            return &guild;
+        }
+    }
+    return nullptr;
+}
+
+bool settings::typed_config::is_public_channel(const dpp::snowflake channel) const {
+    return std::ranges::binary_search(public_channel_ids, channel);
+}
+
+/**
+ * Check that command list data has everything needed to register each command
+ * @param commands Command list data to check
+ * @return Description of the first problem found, or an empty string if it's valid
+ */
+static std::string validate_commands(const nlohmann::json& commands) {
+    if (!commands.is_object()) {
+        return "not a JSON object";
+    }
+    for (const auto& [category, command_list] : commands.items()) {
+        if (!command_list.is_array()) {
+            return std::format("category \"{}\" is not a list", category);
+        }
+        for (const nlohmann::json& command : command_list) {
+            if (!command.is_object() || !command.contains("name") || !command["name"].is_string()) {
+                return std::format("a command in \"{}\" has no name", category);
+            }
+            const std::string name = command["name"];
+            if (!command.contains("description") || !command["description"].is_string() ||
+                !command.contains("options") || !command["options"].is_array()) {
+                return std::format("/{} is missing its description or options", name);
+            }
+            // Commands without a permission level can be used by anyone in the server
+            if (command.contains("permission_level") && !command["permission_level"].is_string()) {
+                return std::format("/{} has a permission level that isn't a string", name);
+            }
+            for (const nlohmann::json& option : command["options"]) {
+                if (!option.is_object() || !option.contains("type") || !option["type"].is_number_unsigned() ||
+                    !option.contains("name") || !option["name"].is_string() ||
+                    !option.contains("description") || !option["description"].is_string() ||
+                    !option.contains("required") || !option["required"].is_boolean()) {
+                    return std::format("/{} has an option missing its type, name, description or required flag", name);
+                }
+            }
+        }
+    }
+    return "";
+}
+
+/**
+ * Read and check a JSON file
+ * @param path Path to the file
+ * @param validate Function to check the parsed data with
+ * @param json Set to the parsed data
+ * @param error Set to the reason if reading fails
+ * @return true if the file was read, parsed and is valid
+ */
+static bool read_json(const std::filesystem::path& path, std::string (*validate)(const nlohmann::json&), nlohmann::json& json, std::string& error) {
+    std::ifstream file(path);
+    if (file.fail()) {
+        error = std::format("Failed to open \"{}\": {}", path.string(), strerror(errno));
+        return false;
+    }
+    try {
+        json = nlohmann::json::parse(file);
+    } catch (const nlohmann::json::exception& e) {
+        error = std::format("Failed to parse \"{}\": {}", path.string(), e.what());
+        return false;
+    }
+    if (const std::string problem = validate(json); !problem.empty()) {
+        error = std::format("Invalid \"{}\": {}", path.string(), problem);
+        return false;
+    }
+    return true;
+}
+
+bool settings::load(const std::filesystem::path& data_path, std::string& error) {
+    auto config = std::make_shared<config_data>();
+    nlohmann::json commands;
+    if (!read_json(data_path / "config.json", validate_config, config->json, error) ||
+        !read_json(data_path / "commands.json", validate_commands, commands, error)) {
+        return false;
+    }
+    if (const std::string problem = resolve_guilds(config->json, config->guilds); !problem.empty()) {
+        error = std::format("Invalid \"{}\": {}", (data_path / "config.json").string(), problem);
+        return false;
+    }
+    current_config.store(std::move(config));
+    current_commands.store(std::make_shared<const nlohmann::json>(std::move(commands)));
+    return true;
+}
+
+settings::snapshot settings::config(const dpp::snowflake guild_id) {
+    // Shares ownership of the whole config_data, so every server's settings live as long as any one's do
+    std::shared_ptr<const config_data> config = current_config.load();
+    const guild_config* guild = find_guild(*config, guild_id);
+    if (guild == nullptr) {
+        return nullptr;
+    }
+    return {config, &guild->json};
+}
+
+settings::snapshot settings::config(const dpp::snowflake guild_id, std::shared_ptr<const typed_config>& typed) {
+    std::shared_ptr<const config_data> config = current_config.load();
+    const guild_config* guild = find_guild(*config, guild_id);
+    if (guild == nullptr) {
+        typed = nullptr;
+        return nullptr;
+    }
+    typed = {config, &guild->typed};
+    return {config, &guild->json};
+}
+
+std::shared_ptr<const settings::typed_config> settings::typed(const dpp::snowflake guild_id) {
+    std::shared_ptr<const config_data> config = current_config.load();
+    const guild_config* guild = find_guild(*config, guild_id);
+    if (guild == nullptr) {
+        return nullptr;
+    }
+    return {config, &guild->typed};
+}
+
+std::vector<dpp::snowflake> settings::guild_ids() {
+    std::vector<dpp::snowflake> guild_ids;
+    for (const guild_config& guild : current_config.load()->guilds) {
+        guild_ids.push_back(guild.typed.guild_id);
+    }
+    return guild_ids;
+}
+
+settings::snapshot settings::commands() {
+    return current_commands.load();
+}
+
+/**
+ * Reload both files, swapping in whichever changed and are still valid
+ * @param data_path Directory the files are in
+ * @param on_reload Called if either file changed, with whether each did
+ */
+static void reload(const std::filesystem::path& data_path, const std::function<void(bool, bool)>& on_reload) {
+    bool config_changed = false;
+    bool commands_changed = false;
+    auto config = std::make_shared<config_data>();
+    nlohmann::json json;
+    std::string error;
+
+    if (!read_json(data_path / "config.json", validate_config, config->json, error)) {
+        util::log("ERROR", "Not reloading config: " + error);
+    } else if (const std::shared_ptr<const config_data> old_config = current_config.load(); config->json != old_config->json) {
+        // The bot is already logged in to this server, so these keep their old values until a restart
+        for (const char* key : {"bot_token", "guild_id"}) {
+            if (config->json[key] != old_config->json[key]) {
+                util::log("WARNING", std::format("\"{}\" was changed in config.json, but the bot must be restarted to use it", key));
+                config->json[key] = old_config->json[key];
+            }
+        }
+        if (config->json != old_config->json) {
+            auto same_guild = [](const guild_config& a, const guild_config& b) {
+                return a.typed.guild_id == b.typed.guild_id;
+            };
+            if (const std::string problem = resolve_guilds(config->json, config->guilds); !problem.empty()) {
+                util::log("ERROR", std::format("Not reloading config: Invalid \"{}\": {}", (data_path / "config.json").string(), problem));
+            } else if (!std::ranges::equal(config->guilds, old_config->guilds, same_guild)) {
+                // Listeners keep caches for each server, which are only set up at startup
+                util::log("ERROR", "Not reloading config: partner servers were added or removed, which needs a restart");
+            } else {
+                current_config.store(std::move(config));
+                config_changed = true;
+            }
+        }
+    }
+
+    if (!read_json(data_path / "commands.json", validate_commands, json, error)) {
+        util::log("ERROR", "Not reloading commands: " + error);
+    } else if (json != *current_commands.load()) {
+        current_commands.store(std::make_shared<const nlohmann::json>(std::move(json)));
+        commands_changed = true;
+    }
+
+    if (config_changed || commands_changed) {
+        util::log("INFO", std::format("Reloaded{}{}", config_changed ? " config.json" : "", commands_changed ? " commands.json" : ""));
+        on_reload(config_changed, commands_changed);
+    }
+}
+
+#ifdef __linux__
+/**
+ * Reload the files whenever inotify reports that one was written or replaced
+ * @param stop Token to stop watching with
+ * @param data_path Directory the files are in
+ * @param on_reload Called after a reload
+ * @return false if inotify couldn't be set up
+ */
+static bool watch_inotify(const std::stop_token& stop, const std::filesystem::path& data_path, const std::function<void(bool, bool)>& on_reload) {
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    // The directory is watched, since editors often save by replacing the file
+    if (inotify_add_watch(fd, data_path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        return false;
+    }
+    alignas(inotify_event) char buffer[4096];
+    pollfd poll_fd = {fd, POLLIN, 0};
+    while (!stop.stop_requested()) {
+        // Wake up every second to check whether to stop
+        if (poll(&poll_fd, 1, 1000) <= 0) {
+            continue;
+        }
+        bool relevant = false;
+        for (ssize_t length; (length = read(fd, buffer, sizeof(buffer))) > 0;) {
+            for (ssize_t i = 0; i < length; i += sizeof(inotify_event) + reinterpret_cast<inotify_event*>(buffer + i)->len) {
+                const inotify_event* event = reinterpret_cast<inotify_event*>(buffer + i);
+                if (event->len != 0 && (strcmp(event->name, "config.json") == 0 || strcmp(event->name, "commands.json") == 0)) {
+                    relevant = true;
+                }
+            }
+        }
+        if (relevant) {
+            reload(data_path, on_reload);
+        }
+    }
+    close(fd);
+    return true;
+}
+#endif
+
+/**
+ * Reload the files whenever one's modification time changes, for systems without inotify
+ * @param stop Token to stop watching with
+ * @param data_path Directory the files are in
+ * @param on_reload Called after a reload
+ */
+static void watch_mtime(const std::stop_token& stop, const std::filesystem::path& data_path, const std::function<void(bool, bool)>& on_reload) {
+    auto mtimes = [&data_path] {
+        std::error_code err;
+        return std::make_pair(std::filesystem::last_write_time(data_path / "config.json", err),
+                              std::filesystem::last_write_time(data_path / "commands.json", err));
+    };
+    auto last = mtimes();
+    std::mutex sleep_mutex;
+    std::unique_lock sleep_lock(sleep_mutex);
+    std::condition_variable_any sleeper;
+    while (!sleeper.wait_for(sleep_lock, stop, std::chrono::seconds(2), []{return false;})) {
+        if (const auto now = mtimes(); now != last) {
+            last = now;
+            reload(data_path, on_reload);
+        }
+    }
+}
+
+std::jthread settings::watch(const std::filesystem::path& data_path, std::function<void(bool, bool)> on_reload) {
+    return std::jthread([data_path, on_reload = std::move(on_reload)](const std::stop_token& stop) {
+#ifdef __linux__
+        if (watch_inotify(stop, data_path, on_reload)) {
+            return;
+        }
+        util::log("WARNING", std::format("Failed to watch \"{}\" with inotify: {}", data_path.string(), strerror(errno)));
+#endif
+        watch_mtime(stop, data_path, on_reload);
+    });
+}
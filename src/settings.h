@@ -0,0 +1,120 @@
+/* settings: Live-reloadable config.json and commands.json
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#pragma once
+#include <dpp/dpp.h>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace settings {
+    /**
+     * Immutable parsed copy of a JSON file. Holding one keeps it alive even after the file is reloaded,
+     * so a handler sees the same settings from start to finish.
+     */
+    using snapshot = std::shared_ptr<const nlohmann::json>;
+
+    /**
+     * Settings that handlers read on every message, resolved from config.json once when it's loaded
+     * so they don't have to be looked up by name and converted each time
+     */
+    struct typed_config {
+        dpp::snowflake guild_id; /**< ID of the server */
+        bool main_guild = false; /**< Whether this is the main server, rather than a partner server */
+        dpp::snowflake disboard_bot_id; /**< ID of the DISBOARD bot, whose bump confirmations start the bump timer */
+        uint32_t ticket_auto_archive_mins; /**< Minutes of inactivity before a ticket thread is archived */
+        std::vector<dpp::snowflake> public_channel_ids; /**< IDs of public channels that aren't for support, sorted */
+        struct {
+            dpp::snowflake owner;
+            dpp::snowflake moderator;
+            dpp::snowflake trial_mod;
+            dpp::snowflake support_team;
+            dpp::snowflake bump_reminder;
+            dpp::snowflake muted;
+        } role_ids; /**< Role IDs */
+        struct {
+            dpp::snowflake general_support;
+        } support_channel_ids; /**< Support channel IDs */
+        struct {
+            dpp::snowflake tickets;
+            dpp::snowflake message_edited;
+            dpp::snowflake message_deleted;
+            dpp::snowflake bot_dm;
+        } log_channel_ids; /**< Log channel IDs */
+        struct {
+            dpp::snowflake bump_reminders;
+            dpp::snowflake ticket_create;
+        } listen_message_ids; /**< IDs of messages whose reactions do something */
+
+        /**
+         * @param channel ID of a channel
+         * @return true if the channel is a public channel that isn't for support
+         */
+        [[nodiscard]] bool is_public_channel(dpp::snowflake channel) const;
+    };
+
+    /**
+     * Load config.json and commands.json for the first time
+     * @param data_path Directory the files are in
+     * @param error Set to the reason if loading fails
+     * @return true if both files were loaded and are valid
+     */
+    bool load(const std::filesystem::path& data_path, std::string& error);
+
+    /**
+     * Get the current bot config data for a server. Each server in "partner_guilds" has its own IDs,
+     * and shares every other setting with the main server.
+     * @param guild_id ID of the server, or 0 (the default) for the main server
+     * @return The server's config data, or nullptr if the bot isn't configured for the server
+     */
+    snapshot config(dpp::snowflake guild_id = 0);
+
+    /**
+     * Get the current bot config data for a server both as JSON and as typed settings, from the same version of config.json.
+     * A handler that needs both should get them here, since separate calls to config() and typed() can straddle a reload.
+     * @param guild_id ID of the server, or 0 for the main server
+     * @param typed Set to the server's typed config data, or nullptr if the bot isn't configured for the server
+     * @return The server's config data, or nullptr if the bot isn't configured for the server
+     */
+    snapshot config(dpp::snowflake guild_id, std::shared_ptr<const typed_config>& typed);
+
+    /**
+     * Get the current bot config data that's used on every message, from the same version of config.json as config()
+     * @param guild_id ID of the server, or 0 (the default) for the main server
+     * @return The server's config data, or nullptr if the bot isn't configured for the server
+     */
+    std::shared_ptr<const typed_config> typed(dpp::snowflake guild_id = 0);
+
+    /**
+     * @return IDs of every server the bot is configured for, starting with the main server. These only change on restart.
+     */
+    std::vector<dpp::snowflake> guild_ids();
+
+    /**
+     * @return Current slash command list
+     */
+    snapshot commands();
+
+    /**
+     * Start the thread that reloads config.json and commands.json when they change on disk.
+     * A file that fails to parse or validate is ignored, and the previous version stays in use.
+     * @param data_path Directory the files are in
+     * @param on_reload Called on the watcher thread after a reload, with whether each file changed
+     * @return Thread watching the files, which stops when it's destroyed or requested to stop
+     */
+    std::jthread watch(const std::filesystem::path& data_path, std::function<void(bool config_changed, bool commands_changed)> on_reload);
+}
@@ -13,7 +13,17 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #include "util.h"
+#include "db.h"
+#include "scheduler.h"
+#include "settings.h"
+#include <bit>
+#include <deque>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 void util::log(const std::string_view severity, const std::string_view message) {
@@ -157,140 +167,550 @@ bool util::is_valid_command_name(const std::string_view command_name) {
     return valid;
 }
 
-dpp::task<dpp::confirmation_callback_t> util::get_message_cached(dpp::cluster* bot, const dpp::snowflake id, const dpp::snowflake channel) {
+static std::mutex message_caches_mutex; /**< Guards message_caches, but not the caches in it */
+static std::unordered_map<dpp::snowflake, std::unique_ptr<util::cache<dpp::message, 1000>>> message_caches; /**< Message cache of each server */
+
+util::cache<dpp::message, 1000>& util::message_cache(const dpp::snowflake guild_id) {
+    std::lock_guard lock(message_caches_mutex);
+    std::unique_ptr<cache<dpp::message, 1000>>& cache = message_caches[guild_id];
+    if (cache == nullptr) {
+        cache = std::make_unique<util::cache<dpp::message, 1000>>();
+    }
+    return *cache;
+}
+
+dpp::task<dpp::confirmation_callback_t> util::get_message_cached(dpp::cluster* bot, const dpp::snowflake guild_id, const dpp::snowflake id, const dpp::snowflake channel) {
     // Try to get message by ID from cache, searching backwards (latest to earliest messages)
-    auto it = MESSAGE_CACHE.end();
-    while (it-- != MESSAGE_CACHE.begin()) {
+    cache<dpp::message, 1000>& messages = message_cache(guild_id);
+    auto it = messages.end();
+    while (it-- != messages.begin()) {
         if (it->id == id) {
             break;
         }
     }
     // If it's not found in the cache, try to get it from Discord
-    if (it == MESSAGE_CACHE.begin() - 1) {
+    if (it == messages.begin() - 1) {
         co_return co_await bot->co_message_get(id, channel);
     }
     // Construct a confirmation_callback_t with the message inside
     co_return dpp::confirmation_callback_t(bot, *it, dpp::http_request_completion_t());
 }
 
-dpp::task<std::pair<util::command_search_result, dpp::snowflake>> util::find_command(dpp::cluster* bot, const nlohmann::json &config, const std::string command_name) {
-    dpp::snowflake command_id(0);
-    command_search_result result = COMMAND_NOT_FOUND;
+/**
+ * A slash command registered with Discord
+ */
+struct indexed_command {
+    dpp::snowflake id; /**< ID of the command */
+    bool global; /**< Whether the command is global or only in the server */
+};
+
+static std::mutex command_index_mutex; /**< Guards the command index below */
+static std::unordered_map<std::string, indexed_command> command_index; /**< Registered slash commands by name */
+static bool global_commands_indexed = false; /**< Whether the global commands have been added to the index */
+static bool guild_commands_indexed = false; /**< Whether the server commands have been added to the index */
 
-    dpp::confirmation_callback_t global_search = co_await bot->co_global_commands_get();
-    if (global_search.is_error()) {
-        co_return {SEARCH_ERROR, command_id};
+void util::index_commands(const dpp::slashcommand_map& commands, const bool global) {
+    std::lock_guard lock(command_index_mutex);
+    std::erase_if(command_index, [global](const auto& command) {
+        return command.second.global == global;
+    });
+    for (const auto& [id, command] : commands) {
+        command_index[command.name] = {id, global};
     }
-    for (const auto &command: std::get<dpp::slashcommand_map>(global_search.value)) {
-        if (command.second.name == command_name) {
-            result = GLOBAL_COMMAND_FOUND;
-            command_id = command.first;
-            break;
+    (global ? global_commands_indexed : guild_commands_indexed) = true;
+}
+
+void util::index_command(const dpp::slashcommand& command, const bool global) {
+    std::lock_guard lock(command_index_mutex);
+    command_index[command.name] = {command.id, global};
+}
+
+void util::unindex_command(const std::string& command_name) {
+    std::lock_guard lock(command_index_mutex);
+    command_index.erase(command_name);
+}
+
+dpp::task<std::pair<util::command_search_result, dpp::snowflake>> util::find_command(dpp::cluster* bot, const dpp::snowflake guild_id, const std::string& command_name) {
+    bool global_indexed, guild_indexed;
+    {
+        std::lock_guard lock(command_index_mutex);
+        global_indexed = global_commands_indexed;
+        guild_indexed = guild_commands_indexed;
+    }
+    // If registration failed or hasn't finished, get the commands from Discord, which also indexes them for next time
+    if (!global_indexed) {
+        const dpp::confirmation_callback_t conf = co_await bot->co_global_commands_get();
+        if (conf.is_error()) {
+            co_return std::make_pair(SEARCH_ERROR, dpp::snowflake(0));
         }
+        index_commands(std::get<dpp::slashcommand_map>(conf.value), true);
+    }
+    if (!guild_indexed) {
+        const dpp::confirmation_callback_t conf = co_await bot->co_guild_commands_get(guild_id);
+        if (conf.is_error()) {
+            co_return std::make_pair(SEARCH_ERROR, dpp::snowflake(0));
+        }
+        index_commands(std::get<dpp::slashcommand_map>(conf.value), false);
     }
 
-    if (result == GLOBAL_COMMAND_FOUND) {
-        co_return {result, command_id};
+    std::lock_guard lock(command_index_mutex);
+    auto command = command_index.find(command_name);
+    if (command == command_index.end()) {
+        co_return std::make_pair(COMMAND_NOT_FOUND, dpp::snowflake(0));
     }
+    co_return std::make_pair(command->second.global ? GLOBAL_COMMAND_FOUND : GUILD_COMMAND_FOUND, command->second.id);
+}
 
-    dpp::confirmation_callback_t guild_search = co_await bot->co_guild_commands_get(config["guild_id"]);
-    if (guild_search.is_error()) {
-        co_return {SEARCH_ERROR, command_id};
+static std::mutex reply_cache_mutex; /**< Guards reply_cache */
+static std::unordered_map<std::string, std::string> reply_cache; /**< Serialized interaction responses by key */
+
+void util::reply_cached(const dpp::slashcommand_t& event, const std::string& key, const std::function<dpp::message()>& build,
+                        const nlohmann::json* config) {
+    std::string payload;
+    {
+        std::lock_guard lock(reply_cache_mutex);
+        auto cached = reply_cache.find(key);
+        if (cached != reply_cache.end()) {
+            payload = cached->second;
+        } else {
+            payload = std::format(R"({{"type":{},"data":{}}})", static_cast<int>(dpp::ir_channel_message_with_source), build().build_json(false, true));
+            // Checked under the lock, so a reload either happens first and this isn't cached, or clears it afterwards
+            if (config == nullptr || config == settings::config().get()) {
+                reply_cache.emplace(key, payload);
+            }
+        }
     }
-    for (const auto &command: std::get<dpp::slashcommand_map>(guild_search.value)) {
-        if (command.second.name == command_name) {
-            result = GUILD_COMMAND_FOUND;
-            command_id = command.first;
-            break;
+    // Same request event.reply makes, but with the body already built
+    event.owner->post_rest(API_PATH "/interactions", std::to_string(event.command.id),
+    dpp::utility::url_encode(event.command.token) + "/callback", dpp::m_post, payload, nullptr);
+}
+
+void util::uncache_reply(const std::string& key) {
+    std::lock_guard lock(reply_cache_mutex);
+    reply_cache.erase(key);
+}
+
+void util::clear_reply_cache() {
+    std::lock_guard lock(reply_cache_mutex);
+    reply_cache.clear();
+}
+
+/**
+ * Roles of the members of a server, kept up to date from gateway events
+ */
+struct member_index {
+    std::unordered_map<dpp::snowflake, std::vector<dpp::snowflake>> roles; /**< Roles of each member, by user ID */
+    std::unordered_map<dpp::snowflake, uint8_t> staff; /**< staff_role flags of each member who has any, by user ID */
+    std::vector<bool> chunks; /**< Which chunks of the member list have arrived */
+    size_t chunks_left = 0; /**< Number of chunks that haven't arrived */
+    bool complete = false; /**< Whether the whole member list has arrived, so anyone not in roles isn't a member */
+};
+
+static std::shared_mutex member_index_mutex; /**< Guards member_indexes */
+static std::unordered_map<dpp::snowflake, member_index> member_indexes; /**< Member index of each server */
+
+/**
+ * Find which staff roles a member has
+ * @param roles The member's roles
+ * @param config Typed config for the member's server
+ * @return staff_role flags of the member
+ */
+static uint8_t staff_roles_of(const std::vector<dpp::snowflake>& roles, const settings::typed_config& config) {
+    uint8_t staff_roles = 0;
+    for (const dpp::snowflake role : roles) {
+        if (role == config.role_ids.owner) staff_roles |= util::STAFF_OWNER;
+        else if (role == config.role_ids.moderator) staff_roles |= util::STAFF_MODERATOR;
+        else if (role == config.role_ids.trial_mod) staff_roles |= util::STAFF_TRIAL_MOD;
+        else if (role == config.role_ids.support_team) staff_roles |= util::STAFF_SUPPORT_TEAM;
+    }
+    return staff_roles;
+}
+
+/**
+ * Record a member's staff roles, keeping only members who have any. member_index_mutex must be held exclusively.
+ * @param guild Member index of the member's server
+ * @param user_id ID of the member
+ * @param staff_roles staff_role flags of the member
+ */
+static void set_staff_roles(member_index& guild, const dpp::snowflake user_id, const uint8_t staff_roles) {
+    if (staff_roles == 0) {
+        guild.staff.erase(user_id);
+    } else {
+        guild.staff.insert_or_assign(user_id, staff_roles);
+    }
+}
+
+void util::index_member(const dpp::guild_member& member) {
+    const std::shared_ptr<const settings::typed_config> config = settings::typed(member.guild_id);
+    if (config == nullptr) {
+        return;
+    }
+    std::unique_lock lock(member_index_mutex);
+    member_index& guild = member_indexes[member.guild_id];
+    guild.roles.insert_or_assign(member.user_id, member.get_roles());
+    set_staff_roles(guild, member.user_id, staff_roles_of(member.get_roles(), *config));
+}
+
+void util::unindex_member(const dpp::snowflake guild_id, const dpp::snowflake user_id) {
+    std::unique_lock lock(member_index_mutex);
+    if (auto guild = member_indexes.find(guild_id); guild != member_indexes.end()) {
+        guild->second.roles.erase(user_id);
+        guild->second.staff.erase(user_id);
+    }
+}
+
+void util::index_member_chunk(const nlohmann::json& chunk) {
+    const dpp::snowflake guild_id(chunk["guild_id"].get<std::string>());
+    const std::shared_ptr<const settings::typed_config> config = settings::typed(guild_id);
+    if (config == nullptr) {
+        return;
+    }
+    const size_t index = chunk["chunk_index"];
+    const size_t count = chunk["chunk_count"];
+    // Parsed before locking, since a chunk has up to 1000 members
+    std::vector<std::tuple<dpp::snowflake, std::vector<dpp::snowflake>, uint8_t>> members;
+    for (const nlohmann::json& member : chunk["members"]) {
+        std::vector<dpp::snowflake> roles;
+        for (const nlohmann::json& role : member["roles"]) {
+            roles.emplace_back(role.get<std::string>());
+        }
+        const uint8_t staff_roles = staff_roles_of(roles, *config);
+        members.emplace_back(dpp::snowflake(member["user"]["id"].get<std::string>()), std::move(roles), staff_roles);
+    }
+
+    std::unique_lock lock(member_index_mutex);
+    member_index& guild = member_indexes[guild_id];
+    if (guild.complete || guild.chunks.size() != count) {
+        guild = member_index();
+        guild.chunks.resize(count);
+        guild.chunks_left = count;
+    }
+    for (auto& [user_id, roles, staff_roles] : members) {
+        guild.roles.insert_or_assign(user_id, std::move(roles));
+        set_staff_roles(guild, user_id, staff_roles);
+    }
+    if (index < count && !guild.chunks[index]) {
+        guild.chunks[index] = true;
+        if (--guild.chunks_left == 0) {
+            guild.complete = true;
+            log("INFO", std::format("Indexed {} members of server {}, {} of them staff", guild.roles.size(), guild_id.str(), guild.staff.size()));
+        }
+    }
+}
+
+void util::reindex_staff() {
+    std::unique_lock lock(member_index_mutex);
+    for (auto& [guild_id, guild] : member_indexes) {
+        const std::shared_ptr<const settings::typed_config> config = settings::typed(guild_id);
+        if (config == nullptr) {
+            continue;
+        }
+        guild.staff.clear();
+        for (const auto& [user_id, roles] : guild.roles) {
+            set_staff_roles(guild, user_id, staff_roles_of(roles, *config));
         }
     }
+}
+
+bool util::find_staff_roles(const dpp::snowflake guild_id, const dpp::snowflake user_id, uint8_t& staff_roles) {
+    std::shared_lock lock(member_index_mutex);
+    auto guild = member_indexes.find(guild_id);
+    if (guild == member_indexes.end() || !guild->second.complete) {
+        return false;
+    }
+    auto member = guild->second.staff.find(user_id);
+    staff_roles = member == guild->second.staff.end() ? 0 : member->second;
+    return true;
+}
 
-    co_return {result, command_id};
+dpp::task<uint8_t> util::get_staff_roles(dpp::cluster* bot, const settings::typed_config& config, const dpp::snowflake user_id) {
+    const dpp::confirmation_callback_t member_conf = co_await bot->co_guild_get_member(config.guild_id, user_id);
+    if (member_conf.is_error()) {
+        co_return 0;
+    }
+    co_return staff_roles_of(std::get<dpp::guild_member>(member_conf.value).get_roles(), config);
+}
+
+/**
+ * Find a member's rank in the staff hierarchy
+ * @param staff_roles staff_role flags of the member
+ * @return 0 for owners, 1 for moderators, 2 for trial mods, 3 for the support team, or 4 for everyone else
+ */
+static int staff_rank(const uint8_t staff_roles) {
+    // The flags are in hierarchy order, so the lowest one set is the highest role
+    return staff_roles == 0 ? 4 : std::countr_zero(staff_roles);
 }
 
-dpp::task<bool> util::check_perms(dpp::cluster* bot, const nlohmann::json& config, const dpp::snowflake issuer, const dpp::snowflake subject) {
-    const dpp::snowflake hierarchy[4] = {config["role_ids"]["owner"], config["role_ids"]["moderator"], config["role_ids"]["trial_mod"], config["role_ids"]["support_team"]};
-    const dpp::confirmation_callback_t issuer_conf = co_await bot->co_guild_get_member(config["guild_id"], issuer);
-    const dpp::confirmation_callback_t subject_conf = co_await bot->co_guild_get_member(config["guild_id"], subject);
-    // If the command issuer is not a server member, they do not have permission
+dpp::task<bool> util::check_perms(dpp::cluster* bot, const settings::typed_config& config, const dpp::snowflake issuer, const dpp::snowflake subject) {
+    {
+        std::shared_lock lock(member_index_mutex);
+        if (auto guild = member_indexes.find(config.guild_id); guild != member_indexes.end() && guild->second.complete) {
+            const member_index& members = guild->second;
+            // If the command issuer is not a server member, they do not have permission
+            if (!members.roles.contains(issuer)) {
+                co_return false;
+            }
+            // If the command subject is not a server member, they cannot be in the hierarchy so the issuer has permission
+            if (!members.roles.contains(subject)) {
+                co_return true;
+            }
+            auto rank = [&members](const dpp::snowflake user_id) {
+                auto member = members.staff.find(user_id);
+                return member == members.staff.end() ? 4 : staff_rank(member->second);
+            };
+            co_return rank(issuer) < rank(subject);
+        }
+    }
+
+    // The member list is still arriving, so ask Discord
+    const dpp::confirmation_callback_t issuer_conf = co_await bot->co_guild_get_member(config.guild_id, issuer);
+    const dpp::confirmation_callback_t subject_conf = co_await bot->co_guild_get_member(config.guild_id, subject);
     if (issuer_conf.is_error()) {
         co_return false;
     }
-    // If the command subject is not a server member, they cannot be in the hierarchy so the issuer has permission
     if (subject_conf.is_error()) {
         co_return true;
     }
+    co_return staff_rank(staff_roles_of(std::get<dpp::guild_member>(issuer_conf.value).get_roles(), config)) <
+              staff_rank(staff_roles_of(std::get<dpp::guild_member>(subject_conf.value).get_roles(), config));
+}
 
-    // Get hierarchy index of role of highest rank for issuer and subject
-    int issuer_rank_index = 4;
-    int subject_rank_index = 4;
-    std::vector<dpp::snowflake> issuer_roles = std::get<dpp::guild_member>(issuer_conf.value).get_roles();
-    std::vector<dpp::snowflake> subject_roles = std::get<dpp::guild_member>(subject_conf.value).get_roles();
-    for (int i = 0; i < 4; i++) {
-        if (std::ranges::find(issuer_roles, hierarchy[i]) != issuer_roles.end()) {
-            issuer_rank_index = i;
-            break;
-        }
+/**
+ * Delete a reminder that has been sent from the DB
+ * @param db SQLite DB pointer to delete from
+ * @param id ID of the reminder
+ */
+static void delete_reminder(sqlite3* db, const int64_t id) {
+    char* error_message;
+    sqlite3_exec(db, std::format("DELETE FROM reminders WHERE id={};", id).c_str(), nullptr, nullptr, &error_message);
+    if (error_message != nullptr) {
+        util::log("SQL ERROR", error_message);
+        sqlite3_free(error_message);
     }
-    for (int i = 0; i < 4; i++) {
-        if (std::ranges::find(subject_roles, hierarchy[i]) != subject_roles.end()) {
-            subject_rank_index = i;
-            break;
+}
+
+static std::mutex belated_mutex; /**< Guards the belated reminder queue below */
+static std::deque<std::vector<util::reminder>> belated_queue; /**< Overdue reminders waiting to be sent, one digest per user */
+static std::unordered_set<int64_t> belated_ids; /**< IDs of queued reminders, which stay in the DB until their DM is sent */
+static size_t belated_sent = 0; /**< Digests sent since the queue was last empty */
+static size_t belated_total = 0; /**< Digests queued since the queue was last empty */
+
+/**
+ * Send one DM of a belated digest, then delete its reminders from the DB if it was delivered.
+ * If it wasn't, the reminders are left in the DB to be queued again with the next window.
+ * @param bot Cluster to send the DM with
+ * @param db SQLite DB pointer to delete the reminders from
+ * @param user ID of user to DM
+ * @param message Message to send
+ * @param ids IDs of the reminders in the message
+ */
+static void send_belated_message(dpp::cluster* bot, sqlite3* db, const dpp::snowflake user, const dpp::message& message, const std::vector<int64_t>& ids) {
+    bot->direct_message_create(user, message, [db, ids](const dpp::confirmation_callback_t& conf) {
+        // Error 50007 means the user doesn't accept DMs from the bot, which trying again won't change
+        if (conf.is_error() && conf.get_error().code != 50007) {
+            util::log("ERROR", std::format("Failed to send belated reminders: {}", conf.get_error().human_readable));
+        } else {
+            std::string id_list;
+            for (const int64_t id : ids) {
+                id_list += (id_list.empty() ? "" : ", ") + std::to_string(id);
+            }
+            // A single statement is a single transaction
+            char* error_message;
+            sqlite3_exec(db, std::format("DELETE FROM reminders WHERE id IN ({});", id_list).c_str(), nullptr, nullptr, &error_message);
+            if (error_message != nullptr) {
+                util::log("SQL ERROR", error_message);
+                sqlite3_free(error_message);
+            }
         }
+        std::lock_guard lock(belated_mutex);
+        for (const int64_t id : ids) {
+            belated_ids.erase(id);
+        }
+    });
+}
+
+/**
+ * Send one user all of their overdue reminders in as few DMs as possible
+ * @param bot Cluster to send the DMs with
+ * @param db SQLite DB pointer to delete the reminders from once they're sent
+ * @param reminders Overdue reminders, all for the same user
+ */
+static void send_belated_digest(dpp::cluster* bot, sqlite3* db, const std::vector<util::reminder>& reminders) {
+    std::string description = reminders.size() == 1 ? "Sorry, the bot was offline when you were supposed to get this reminder."
+                            : std::format("Sorry, the bot was offline when you were supposed to get these {} reminders.", reminders.size());
+    dpp::message message;
+    std::vector<int64_t> ids;
+    dpp::embed embed = dpp::embed().set_title(reminders.size() == 1 ? "Belated Reminder" : "Belated Reminders")
+                                   .set_color(util::color::DEFAULT).set_description(description);
+    // Characters in every embed of the message so far, which Discord limits to 6000 in total
+    size_t length = embed.title.size() + description.size();
+    for (const util::reminder& reminder : reminders) {
+        std::string name = "Reminder of " + util::seconds_to_fancytime(reminder.end_time - reminder.start_time, 4);
+        std::string value = std::format("From <t:{}:F>\n{}", reminder.start_time, reminder.text.substr(0, 900));
+        const bool message_full = length + name.size() + value.size() > 6000;
+        // Start another embed after 25 fields, and another message after 10 embeds or before going over 6000 characters
+        if (embed.fields.size() == 25 || message_full) {
+            message.add_embed(embed);
+            if (message.embeds.size() == 10 || message_full) {
+                send_belated_message(bot, db, reminder.user, message, ids);
+                message = dpp::message();
+                ids.clear();
+                length = 0;
+            }
+            embed = dpp::embed().set_color(util::color::DEFAULT);
+        }
+        length += name.size() + value.size();
+        embed.add_field(name, value, false);
+        ids.push_back(reminder.id);
     }
-    co_return issuer_rank_index < subject_rank_index;
+    message.add_embed(embed);
+    send_belated_message(bot, db, reminders[0].user, message, ids);
 }
 
-dpp::job util::remind(dpp::cluster* bot, sqlite3* db, const reminder reminder) {
-    const time_t now = time(nullptr);
-    if (reminder.end_time < now) {
-        // If reminder end time has already passed, send the user a belated reminder notification
-        dpp::embed embed = dpp::embed().set_title("Belated Reminder").set_color(DEFAULT)
-        .set_description(std::format("Sorry, the bot was offline when you were supposed to get your reminder of {} from <t:{}>.",
-        seconds_to_fancytime(reminder.end_time - reminder.start_time, 4), reminder.start_time))
-        .add_field("Reminder", reminder.text);
-        bot->direct_message_create(reminder.user, dpp::message(embed));
-        // Remove reminder from DB
-        char* error_message;
-        sqlite3_exec(db, std::format("DELETE FROM reminders WHERE id={};", reminder.id).c_str(), nullptr, nullptr, &error_message);
-        if (error_message != nullptr) {
-            log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
+/**
+ * Send the next digest in the belated reminder queue, then schedule sending the one after it on the next tick,
+ * so a long outage doesn't flood the rate limiter with DMs
+ * @param bot Cluster to send the DMs with
+ * @param db SQLite DB pointer to delete the reminders from once they're sent
+ */
+static void send_next_belated(dpp::cluster* bot, sqlite3* db) {
+    std::vector<util::reminder> reminders;
+    size_t sent, total;
+    bool more;
+    {
+        std::lock_guard lock(belated_mutex);
+        reminders = std::move(belated_queue.front());
+        belated_queue.pop_front();
+        sent = ++belated_sent;
+        total = belated_total;
+        more = !belated_queue.empty();
+    }
+    send_belated_digest(bot, db, reminders);
+    if (sent % 10 == 0 || !more) {
+        util::log("INFO", std::format("Sent belated reminders to {} of {} users", sent, total));
+    }
+    if (more) {
+        scheduler::schedule(time(nullptr), [bot, db] {
+            send_next_belated(bot, db);
+        });
+    }
+}
+
+/**
+ * Queue overdue reminders to be sent as one digest per user, skipping any already queued.
+ * They're deleted from the DB as their DMs are delivered.
+ * @param bot Cluster to send the DMs with
+ * @param db SQLite DB pointer to delete the reminders from once they're sent
+ * @param reminders Overdue reminders
+ */
+static void queue_belated(dpp::cluster* bot, sqlite3* db, const std::vector<util::reminder>& reminders) {
+    std::map<dpp::snowflake, std::vector<util::reminder>> digests;
+    size_t queued = 0;
+    bool start;
+    {
+        std::lock_guard lock(belated_mutex);
+        for (const util::reminder& reminder : reminders) {
+            if (belated_ids.insert(reminder.id).second) {
+                digests[reminder.user].push_back(reminder);
+                queued++;
+            }
         }
-        co_return;
+        if (digests.empty()) {
+            return;
+        }
+        start = belated_queue.empty();
+        if (start) {
+            belated_sent = 0;
+            belated_total = 0;
+        }
+        for (auto& digest : digests | std::views::values) {
+            belated_queue.push_back(std::move(digest));
+        }
+        belated_total += digests.size();
+    }
+    util::log("INFO", std::format("Queued {} belated reminders for {} users", queued, digests.size()));
+    if (start) {
+        scheduler::schedule(time(nullptr), [bot, db] {
+            send_next_belated(bot, db);
+        });
+    }
+}
+
+static std::mutex window_mutex; /**< Guards the scheduling window state below */
+static time_t window_end = 0; /**< Reminders and mutes ending before this time have been scheduled */
+static std::unordered_map<int64_t, uint64_t> scheduled_reminders; /**< Scheduler IDs of reminders in the window, by reminder ID */
+static std::unordered_map<int64_t, uint64_t> scheduled_mutes; /**< Scheduler IDs of mutes in the window, by mute ID */
+
+/**
+ * Schedule a reminder's notification DM unless it's already scheduled. window_mutex must be held.
+ * @param bot Cluster to send the reminder DM with
+ * @param db SQLite DB pointer with the database to delete reminder from
+ * @param reminder reminder to send
+ */
+static void schedule_reminder(dpp::cluster* bot, sqlite3* db, const util::reminder& reminder) {
+    if (scheduled_reminders.contains(reminder.id)) {
+        return;
     }
+    scheduled_reminders[reminder.id] = scheduler::schedule(reminder.end_time, [bot, db, reminder] {
+        {
+            std::lock_guard lock(window_mutex);
+            scheduled_reminders.erase(reminder.id);
+        }
+        // Send user reminder notification
+        dpp::embed embed = dpp::embed().set_title(std::format("Reminder of {} from <t:{}>",
+        util::seconds_to_fancytime(reminder.end_time - reminder.start_time, 4),
+        reminder.start_time)).set_color(util::color::DEFAULT).set_description(reminder.text);
+        bot->direct_message_create(reminder.user, dpp::message(embed));
+        delete_reminder(db, reminder.id);
+    });
+}
 
-    co_await bot->co_sleep(reminder.end_time - now);
+void util::remind(dpp::cluster* bot, sqlite3* db, const reminder reminder) {
+    std::lock_guard lock(window_mutex);
+    // Reminders past the end of the window are scheduled once it reaches them
+    if (reminder.end_time < window_end) {
+        schedule_reminder(bot, db, reminder);
+    }
+}
 
-    // Send user reminder notification
-    dpp::embed embed = dpp::embed().set_title(std::format("Reminder of {} from <t:{}>",
-    seconds_to_fancytime(reminder.end_time - reminder.start_time, 4),
-    reminder.start_time)).set_color(DEFAULT).set_description(reminder.text);
-    bot->direct_message_create(reminder.user, dpp::message(embed));
-    // Remove reminder from DB
+bool util::cancel_reminder(sqlite3* db, const int64_t id, const dpp::snowflake user) {
+    // Held so the window can't schedule the reminder between deleting it and cancelling its timer
+    std::lock_guard lock(window_mutex);
     char* error_message;
-    sqlite3_exec(db, std::format("DELETE FROM reminders WHERE id={};", reminder.id).c_str(), nullptr, nullptr, &error_message);
+    sqlite3_mutex_enter(sqlite3_db_mutex(db));
+    sqlite3_exec(db, std::format("DELETE FROM reminders WHERE id={} AND user='{}';", id, user.str()).c_str(), nullptr, nullptr, &error_message);
+    const bool deleted = error_message == nullptr && sqlite3_changes(db) != 0;
+    sqlite3_mutex_leave(sqlite3_db_mutex(db));
     if (error_message != nullptr) {
         log("SQL ERROR", error_message);
         sqlite3_free(error_message);
+        return false;
+    }
+    if (auto it = scheduled_reminders.find(id); deleted && it != scheduled_reminders.end()) {
+        scheduler::cancel(it->second);
+        scheduled_reminders.erase(it);
     }
+    return deleted;
 }
 
-dpp::job util::handle_mute(dpp::cluster* bot, sqlite3* db, const nlohmann::json& config, const mute mute) {
-    // Wait until mute expires, unless expiry time has already passed
-    const time_t now = time(nullptr);
-    if (mute.end_time > now) {
-        co_await bot->co_sleep(mute.end_time - now);
-    }
+/**
+ * Unmute a user whose mute has expired, then send them a notification and log it
+ * @param bot Cluster to do these actions with
+ * @param db SQLite DB pointer with the database to deactivate mute in
+ * @param mute Mute that has expired
+ */
+static dpp::job end_mute(dpp::cluster* bot, sqlite3* db, const util::mute mute) {
+    // Config of the mute's server as of when the mute ends, kept for the whole job even if it's reloaded
+    const settings::snapshot config_snapshot = settings::config(mute.guild);
     // Mark mute as inactive in DB
     if (mute.id != 0) {
-        char* error_message;
-        sqlite3_exec(db, std::format("UPDATE mod_records SET active = 'false' WHERE extra_data={};", mute.id).c_str(), nullptr, nullptr, &error_message);
-        if (error_message != nullptr) {
-            log("SQL ERROR", error_message);
-            sqlite3_free(error_message);
-        }
+        db::deactivate_mute(db, mute);
+    }
+    // The server may have been removed from the config since the user was muted
+    if (config_snapshot == nullptr) {
+        co_return;
     }
+    const nlohmann::json& config = *config_snapshot;
     // No messages sent if user has left server or is no longer muted
     dpp::confirmation_callback_t member_conf = co_await bot->co_guild_get_member(config["guild_id"], mute.user);
     if (member_conf.is_error()) {
@@ -302,8 +722,8 @@ dpp::job util::handle_mute(dpp::cluster* bot, sqlite3* db, const nlohmann::json&
         co_return;
     }
     // Send user notification and log the unmute action
-    dpp::embed dm_embed = dpp::embed().set_color(GREEN).set_title("You have been automatically unmuted.");
-    dpp::embed log_embed = dpp::embed().set_color(GREEN).set_title("Mute removed").set_thumbnail(user.get_user()->get_avatar_url())
+    dpp::embed dm_embed = dpp::embed().set_color(util::color::GREEN).set_title("You have been automatically unmuted.");
+    dpp::embed log_embed = dpp::embed().set_color(util::color::GREEN).set_title("Mute removed").set_thumbnail(user.get_user()->get_avatar_url())
                                        .add_field("User unmuted", user.get_nickname(), true)
                                        .add_field("User ID", mute.user.str(), true)
                                        .add_field("Reason", "Automatic unmute", false);
@@ -314,10 +734,174 @@ dpp::job util::handle_mute(dpp::cluster* bot, sqlite3* db, const nlohmann::json&
     bot->message_create(dpp::message(config["log_channel_ids"]["mod_log"], log_embed));
 }
 
-dpp::job util::handle_bump(dpp::cluster* bot, const nlohmann::json& config, const dpp::snowflake channel, const time_t seconds, bool& bump_timer_running) {
-    co_await bot->co_sleep(seconds);
-    bot->message_create(dpp::message(channel, std::format("Time to bump the server!\n"
-    "<@&{}>, could someone please run `/bump`?", config["role_ids"]["bump_reminder"].get<uint64_t>())
-    ).set_allowed_mentions(false, true));
-    bump_timer_running = false;
-}
\ No newline at end of file
+/**
+ * Schedule the end of a mute unless it's already scheduled. window_mutex must be held.
+ * @param bot Cluster to do these actions with
+ * @param db SQLite DB pointer with the database to deactivate mute in
+ * @param mute mute info to use
+ */
+static void schedule_mute(dpp::cluster* bot, sqlite3* db, const util::mute& mute) {
+    if (scheduled_mutes.contains(mute.id)) {
+        return;
+    }
+    // A mute that has already expired ends on the next tick
+    scheduled_mutes[mute.id] = scheduler::schedule(mute.end_time, [bot, db, mute] {
+        {
+            std::lock_guard lock(window_mutex);
+            scheduled_mutes.erase(mute.id);
+        }
+        end_mute(bot, db, mute);
+    });
+}
+
+void util::handle_mute(dpp::cluster* bot, sqlite3* db, const mute mute) {
+    // A mute that isn't in the DB will never be loaded into the window, so it's scheduled right away
+    if (mute.id == 0) {
+        scheduler::schedule(mute.end_time, [bot, db, mute] {
+            end_mute(bot, db, mute);
+        });
+        return;
+    }
+    std::lock_guard lock(window_mutex);
+    if (mute.end_time < window_end) {
+        schedule_mute(bot, db, mute);
+    }
+}
+
+void util::cancel_mute(const int64_t id) {
+    std::lock_guard lock(window_mutex);
+    if (auto it = scheduled_mutes.find(id); it != scheduled_mutes.end()) {
+        scheduler::cancel(it->second);
+        scheduled_mutes.erase(it);
+    }
+}
+
+/**
+ * Schedule the reminders and mutes in the DB that end before a given time, and move the end of the window to it
+ * @param bot Cluster to do scheduled actions with
+ * @param db SQLite DB pointer to load from
+ * @param until New end of the window
+ */
+static void extend_window(dpp::cluster* bot, sqlite3* db, const time_t until) {
+    std::vector<util::reminder> reminders;
+    std::vector<util::mute> mutes;
+    // Held while querying, so remind and handle_mute can't schedule a row the queries also find
+    std::lock_guard lock(window_mutex);
+    if (!db::get_reminders(db, until, reminders) || !db::get_active_mutes(db, window_end, until, mutes)) {
+        util::log("ERROR", "Failed to load reminders and mutes from DB, trying again at the next window");
+        return;
+    }
+
+    const time_t now = time(nullptr);
+    std::vector<util::reminder> belated;
+    for (const util::reminder& reminder : reminders) {
+        if (scheduled_reminders.contains(reminder.id)) {
+            continue;
+        }
+        if (reminder.end_time < now) {
+            belated.push_back(reminder);
+            continue;
+        }
+        std::string log_message = "Scheduling reminder of " + util::seconds_to_fancytime(reminder.end_time - reminder.start_time, 4);
+        if (const dpp::user* user = dpp::find_user(reminder.user); user != nullptr) {
+            log_message += " from " + user->username;
+        }
+        util::log("INFO", log_message);
+        schedule_reminder(bot, db, reminder);
+    }
+    // Reminders whose DMs fail are still in the DB, so they're queued again with the next window
+    if (!belated.empty()) {
+        queue_belated(bot, db, belated);
+    }
+    for (const util::mute& mute : mutes) {
+        if (scheduled_mutes.contains(mute.id)) {
+            continue;
+        }
+        std::string log_message = mute.end_time < now ? "Belated removal of" : "Scheduling end of";
+        log_message += " mute of " + util::seconds_to_fancytime(mute.end_time - mute.start_time, 4);
+        if (const dpp::user* user = dpp::find_user(mute.user); user != nullptr) {
+            log_message += " from " + user->username;
+        }
+        util::log("INFO", log_message);
+        schedule_mute(bot, db, mute);
+    }
+    window_end = until;
+}
+
+/**
+ * Extend the window to a full length from now, then schedule doing it again halfway through,
+ * so everything is always scheduled at least half a window before it's due.
+ * The window length is read from the config each time, so a reload takes effect at the next step.
+ * @param bot Cluster to do scheduled actions with
+ * @param db SQLite DB pointer to load from
+ */
+static void advance_window(dpp::cluster* bot, sqlite3* db) {
+    const time_t window = (*settings::config())["schedule_window_minutes"].get<time_t>() * 60;
+    extend_window(bot, db, time(nullptr) + window);
+    scheduler::schedule(time(nullptr) + window / 2, [bot, db] {
+        advance_window(bot, db);
+    });
+}
+
+void util::start_schedule_window(dpp::cluster* bot, sqlite3* db) {
+    advance_window(bot, db);
+}
+
+static std::mutex bump_mutex; /**< Guards bump_timers */
+static std::unordered_map<dpp::snowflake, uint64_t> bump_timers; /**< Scheduler IDs of the running bump timers, by server */
+
+/**
+ * Schedule a server's bump reminder, and clear the timer from memory and the DB when it's sent. bump_mutex must be held.
+ * @param bot Bot cluster to send reminder message with
+ * @param db SQLite DB pointer to clear the timer from
+ * @param guild ID of the server to remind
+ * @param channel ID of channel to send reminder to
+ * @param deadline Unix time to send the reminder at
+ */
+static void schedule_bump(dpp::cluster* bot, sqlite3* db, const dpp::snowflake guild, const dpp::snowflake channel, const time_t deadline) {
+    bump_timers[guild] = scheduler::schedule(deadline, [bot, db, guild, channel] {
+        // The server may have been removed from the config while the timer was running
+        if (const std::shared_ptr<const settings::typed_config> typed = settings::typed(guild); typed != nullptr) {
+            bot->message_create(dpp::message(channel, std::format("Time to bump the server!\n"
+            "<@&{}>, could someone please run `/bump`?", static_cast<uint64_t>(typed->role_ids.bump_reminder))
+            ).set_allowed_mentions(false, true));
+        }
+        std::lock_guard lock(bump_mutex);
+        db::delete_state(db, guild, {"bump_deadline", "bump_channel"});
+        bump_timers.erase(guild);
+    });
+}
+
+bool util::start_bump_timer(dpp::cluster* bot, sqlite3* db, const dpp::snowflake guild, const dpp::snowflake channel, const time_t seconds) {
+    std::lock_guard lock(bump_mutex);
+    if (bump_timers.contains(guild)) {
+        return false;
+    }
+    const time_t deadline = time(nullptr) + seconds;
+    // Saved before scheduling, so the timer is never running without being in the DB
+    if (!db::set_state(db, guild, {{"bump_deadline", deadline}, {"bump_channel", static_cast<int64_t>(static_cast<uint64_t>(channel))}})) {
+        return false;
+    }
+    schedule_bump(bot, db, guild, channel, deadline);
+    return true;
+}
+
+void util::resume_bump_timers(dpp::cluster* bot, sqlite3* db) {
+    for (const dpp::snowflake guild : settings::guild_ids()) {
+        std::map<std::string, int64_t> state;
+        if (!db::get_state(db, guild, state)) {
+            log("ERROR", std::format("Failed to load bump timer for server {} from DB", guild.str()));
+            continue;
+        }
+        if (!state.contains("bump_deadline") || !state.contains("bump_channel")) {
+            continue;
+        }
+        std::lock_guard lock(bump_mutex);
+        if (bump_timers.contains(guild)) {
+            continue;
+        }
+        const time_t deadline = state["bump_deadline"];
+        log("INFO", std::format("{} for server {}", deadline < time(nullptr) ? "Belated bump reminder" : "Resuming bump timer", guild.str()));
+        schedule_bump(bot, db, guild, static_cast<uint64_t>(state["bump_channel"]), deadline);
+    }
+}
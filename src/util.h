@@ -13,6 +13,7 @@
  * this program. If not, see <https://www.gnu.org/licenses/>.
  */
 #pragma once
+#include "settings.h"
 #include <dpp/dpp.h>
 #include <sqlite3.h>
 
@@ -157,9 +158,12 @@ namespace util {
     };
 
     /**
-     * Global cache of the 1000 latest messages (~1.25 MB plus string contents)
+     * Get the cache of the 1000 latest messages in a server (~1.25 MB plus string contents).
+     * Each server has its own, so a busy one can't push another's messages out.
+     * @param guild_id ID of the server, or 0 for DMs
+     * @return The server's message cache, which is created the first time it's needed
      */
-    inline cache<dpp::message, 1000> MESSAGE_CACHE;
+    cache<dpp::message, 1000>& message_cache(dpp::snowflake guild_id);
 
     /**
      * Possible result types for a slash command search
@@ -213,6 +217,7 @@ namespace util {
         time_t end_time; /**< Time when notification should happen */
         dpp::snowflake user; /**< ID of user who requested the reminder */
         std::string text; /**< Text of the reminder */
+        dpp::snowflake guild; /**< ID of the server the reminder was requested in */
     };
 
     /**
@@ -223,6 +228,7 @@ namespace util {
         dpp::snowflake user; /**< ID of user who is muted */
         time_t start_time; /**< Time when user was muted */
         time_t end_time; /**< Time when mute expires */
+        dpp::snowflake guild; /**< ID of the server the user is muted in */
     };
 
     /**
@@ -272,56 +278,190 @@ namespace util {
     /**
      * Try to find a message in the cache, and get it via API if it's not cached.
      * @param bot Bot cluster to use for API call if message cannot be found in cache
+     * @param guild_id ID of the server the message is in, or 0 for DMs
      * @param channel ID of the channel the message is in
      * @param id ID of the message
      * @return confirmation_callback_t containing the message if it exists.
      */
-    dpp::task<dpp::confirmation_callback_t> get_message_cached(dpp::cluster* bot, dpp::snowflake id, dpp::snowflake channel);
+    dpp::task<dpp::confirmation_callback_t> get_message_cached(dpp::cluster* bot, dpp::snowflake guild_id, dpp::snowflake id, dpp::snowflake channel);
 
     /**
-     * Find a slash command by name
-     * @param bot Cluster to use for command search
-     * @param config JSON bot config data
+     * Replace the global or server commands in the local index of registered slash commands
+     * @param commands Commands registered with Discord, by ID
+     * @param global Whether these are the global commands or the server commands
+     */
+    void index_commands(const dpp::slashcommand_map& commands, bool global);
+
+    /**
+     * Add a newly registered slash command to the local index
+     * @param command Command returned by Discord, with its ID
+     * @param global Whether the command is global or only in the server
+     */
+    void index_command(const dpp::slashcommand& command, bool global);
+
+    /**
+     * Remove a deleted slash command from the local index
+     * @param command_name Name of the command
+     */
+    void unindex_command(const std::string& command_name);
+
+    /**
+     * Find a registered slash command by name in the local index.
+     * If registration didn't index the commands, they're fetched from Discord and indexed first.
+     * @param bot Cluster to fetch the commands with
+     * @param guild_id ID of the server to fetch server commands from
      * @param command_name Name of command to search for
      * @return Pair of a command_search_result enum and a snowflake with the command's ID if found, 0 otherwise.
+     *         SEARCH_ERROR if the commands weren't indexed and couldn't be fetched.
      */
-    dpp::task<std::pair<command_search_result, dpp::snowflake>> find_command(dpp::cluster* bot, const nlohmann::json &config, std::string command_name);
+    dpp::task<std::pair<command_search_result, dpp::snowflake>> find_command(dpp::cluster* bot, dpp::snowflake guild_id, const std::string& command_name);
 
     /**
-     * Make sure a user is allowed to run a command against another user
+     * Reply to a slash command with a message that's the same every time. The reply is serialized the first
+     * time and the same payload is sent after that, until it's removed from the cache.
+     * @param event Slash command event to reply to
+     * @param key Name to cache the reply under, such as the command name
+     * @param build Function to build the reply if it isn't cached
+     * @param config Config data the reply is built from, if any. The reply is only cached if this is still the current
+     *               config, so a handler holding an older snapshot can't cache a stale reply after a reload clears the cache.
+     */
+    void reply_cached(const dpp::slashcommand_t& event, const std::string& key, const std::function<dpp::message()>& build,
+                      const nlohmann::json* config = nullptr);
+
+    /**
+     * Remove a reply from the cache, so it's rebuilt the next time it's sent
+     * @param key Name the reply is cached under
+     */
+    void uncache_reply(const std::string& key);
+
+    /**
+     * Remove every reply from the cache, such as when the config they're built from changes
+     */
+    void clear_reply_cache();
+
+    /**
+     * Staff roles a member can have, as flags in hierarchy order from highest to lowest
+     */
+    enum staff_role : uint8_t {
+        STAFF_OWNER = 1 << 0, /**< Owner role */
+        STAFF_MODERATOR = 1 << 1, /**< Moderator role */
+        STAFF_TRIAL_MOD = 1 << 2, /**< Trial mod role */
+        STAFF_SUPPORT_TEAM = 1 << 3 /**< Support team role */
+    };
+
+    /**
+     * Add a member to the local member index, or update their roles if they're already in it
+     * @param member Member who joined or was updated
+     */
+    void index_member(const dpp::guild_member& member);
+
+    /**
+     * Remove a member from the local member index
+     * @param guild_id ID of the server they left
+     * @param user_id ID of the member
+     */
+    void unindex_member(dpp::snowflake guild_id, dpp::snowflake user_id);
+
+    /**
+     * Add a chunk of a server's member list to the local member index. Once every chunk has arrived, the index
+     * has the whole server, and check_perms uses it instead of asking Discord. A chunk arriving after that starts
+     * the index over, since it means the member list is being sent again after a reconnect.
+     * @param chunk Data of a GUILD_MEMBERS_CHUNK gateway event
+     */
+    void index_member_chunk(const nlohmann::json& chunk);
+
+    /**
+     * Work out the staff roles of everyone in the local member index again, for when the role IDs in the config change
+     */
+    void reindex_staff();
+
+    /**
+     * Look up a member's staff roles in the local member index, without asking Discord
+     * @param guild_id ID of the server
+     * @param user_id ID of the member
+     * @param staff_roles Set to the member's staff_role flags, or 0 if they have none or aren't a member
+     * @return false if the server's member list hasn't all arrived yet, so the index can't tell
+     */
+    bool find_staff_roles(dpp::snowflake guild_id, dpp::snowflake user_id, uint8_t& staff_roles);
+
+    /**
+     * Get a member's staff roles from Discord, for when find_staff_roles can't tell
+     * @param bot Bot cluster to get the member with
+     * @param config Typed config for the member's server
+     * @param user_id ID of the member
+     * @return The member's staff_role flags, or 0 if they have none or aren't a member
+     */
+    dpp::task<uint8_t> get_staff_roles(dpp::cluster* bot, const settings::typed_config& config, dpp::snowflake user_id);
+
+    /**
+     * Make sure a user is allowed to run a command against another user.
+     * Members are looked up in the local member index, or with Discord if it isn't complete yet.
      * @param bot Pointer to bot cluster to find guild members with
-     * @param config JSON bot configuration
+     * @param config Typed bot configuration
      * @param issuer ID of user who issued the command
      * @param subject ID of user the command is acting on
      * @return true if the issuer is higher in the role hierarchy than the subject
      */
-    dpp::task<bool> check_perms(dpp::cluster* bot, const nlohmann::json& config, dpp::snowflake issuer, dpp::snowflake subject);
+    dpp::task<bool> check_perms(dpp::cluster* bot, const settings::typed_config& config, dpp::snowflake issuer, dpp::snowflake subject);
 
     /**
-     * Wait for the duration of a reminder, then send the user a notification DM
+     * Schedule a reminder's notification DM if it's due within the scheduling window.
+     * Later reminders are left in the DB and scheduled when the window reaches them.
      * @param bot Cluster to send the reminder DM with
      * @param db SQLite DB pointer with the database to delete reminder from
-     * @param reminder reminder to send
+     * @param reminder reminder to send, which must already be in the DB
      */
-    dpp::job remind(dpp::cluster* bot, sqlite3* db, reminder reminder);
+    void remind(dpp::cluster* bot, sqlite3* db, reminder reminder);
 
     /**
-     * Wait for the duration of a mute, then unmute the user and send a notification and log
+     * Delete a reminder from the DB and cancel its notification if it's scheduled
+     * @param db SQLite DB pointer with the database to delete reminder from
+     * @param id ID of the reminder
+     * @param user ID of user who must own the reminder
+     * @return true if the user had a reminder with that ID
+     */
+    bool cancel_reminder(sqlite3* db, int64_t id, dpp::snowflake user);
+
+    /**
+     * Schedule the end of a mute, when the user is unmuted and sent a notification and log, if it's within the
+     * scheduling window. Later mutes are left in the DB and scheduled when the window reaches them.
      * @param bot Cluster to do these actions with
      * @param db SQLite DB pointer with the database to deactivate mute in
-     * @param config JSON bot config data
      * @param mute mute info to use
-     * @return
      */
-    dpp::job handle_mute(dpp::cluster* bot, sqlite3* db, const nlohmann::json& config, mute mute);
+    void handle_mute(dpp::cluster* bot, sqlite3* db, mute mute);
+
+    /**
+     * Cancel the scheduled end of a mute, for when the user has already been unmuted
+     * @param id ID of the mute in the DB
+     */
+    void cancel_mute(int64_t id);
 
     /**
-     * Wait for some time then send a DISBOARD bump reminder.
+     * Schedule the reminders and mutes in the DB that are due within the scheduling window, including overdue ones,
+     * then keep moving the window forward and scheduling the ones it reaches
+     * @param bot Cluster to do scheduled actions with
+     * @param db SQLite DB pointer to load reminders and mutes from
+     */
+    void start_schedule_window(dpp::cluster* bot, sqlite3* db);
+
+    /**
+     * Start a server's DISBOARD bump reminder timer unless it's already running.
+     * The deadline is saved in the DB so the timer survives a restart.
      * @param bot Bot cluster to send reminder message with
-     * @param config JSON bot config data
+     * @param db SQLite DB pointer to save the timer in
+     * @param guild ID of the server to remind
      * @param channel ID of channel to send reminder to
      * @param seconds Number of seconds to wait
-     * @param bump_timer_running Whether the bump timer is currently running
+     * @return true if the timer was started, false if it was already running or couldn't be saved
+     */
+    bool start_bump_timer(dpp::cluster* bot, sqlite3* db, dpp::snowflake guild, dpp::snowflake channel, time_t seconds);
+
+    /**
+     * Restart the bump reminder timers saved in the DB for each configured server. A deadline that passed while
+     * the bot was offline sends the reminder right away.
+     * @param bot Bot cluster to send reminder messages with
+     * @param db SQLite DB pointer to load the timers from
      */
-    dpp::job handle_bump(dpp::cluster* bot, const nlohmann::json& config, dpp::snowflake channel, time_t seconds, bool& bump_timer_running);
+    void resume_bump_timers(dpp::cluster* bot, sqlite3* db);
 }
@@ -0,0 +1,106 @@
+/* state_test: Round trip of bot_state keys through the DB, and moving them to their servers when the DB is partitioned
+ * Copyright 2025 Ben Westover <me@benthetechguy.net>
+ *
+ * This program is free software: you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 3 of the License, or (at your option)
+ * any later version. This program is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General
+ * Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+#include "db.h"
+#include <iostream>
+
+int main() {
+    // The tables init_schema changes or reads, as they were before the DB was partitioned by server
+    sqlite3* db;
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK ||
+        !db::execute(db, "CREATE TABLE reminders(id INTEGER PRIMARY KEY ASC, start_time INTEGER, end_time INTEGER, user TEXT, text TEXT) STRICT;") ||
+        !db::execute(db, "CREATE TABLE mutes(id INTEGER PRIMARY KEY ASC, start_time INTEGER, end_time INTEGER);") ||
+        !db::execute(db, "CREATE TABLE mod_records(id TEXT PRIMARY KEY, type TEXT, moderator TEXT, user TEXT, reason TEXT, active TEXT, extra_data INTEGER) WITHOUT ROWID;") ||
+        !db::execute(db, "CREATE TABLE staff_applications(id TEXT, time INTEGER, type TEXT, status TEXT, q1 TEXT, q2 TEXT, q3 TEXT, q4 TEXT, q5 TEXT, "
+                         "q6 TEXT, q7 TEXT, q8 TEXT, q9 TEXT, q10 TEXT);") ||
+        !db::execute(db, "CREATE TABLE ban_appeals(id TEXT, email TEXT, time INTEGER, status TEXT, reason TEXT, appeal TEXT);") ||
+        !db::execute(db, "CREATE TABLE bot_state(key TEXT PRIMARY KEY, value INTEGER) WITHOUT ROWID;") ||
+        !db::execute(db, "INSERT INTO bot_state VALUES ('commands:global:ping', 7), ('bump_deadline', 8);")) {
+        std::cerr << "Failed to create test DB" << std::endl;
+        return 1;
+    }
+    int failures = 0;
+    const dpp::snowflake main_guild = 100;
+    const dpp::snowflake partner_guild = 200;
+
+    // Global command hashes aren't for any server, and everything else was the main server's
+    std::map<std::string, int64_t> global;
+    std::map<std::string, int64_t> got;
+    if (!db::init_schema(db, main_guild) || !db::get_state(db, 0, global) || !db::get_state(db, main_guild, got)) {
+        std::cerr << "Failed to partition state" << std::endl;
+        return 1;
+    }
+    if (global != std::map<std::string, int64_t>{{"commands:global:ping", 7}} || got != std::map<std::string, int64_t>{{"bump_deadline", 8}}) {
+        std::cerr << "State wasn't moved to the right servers" << std::endl;
+        failures++;
+    }
+    got.clear();
+    if (!db::delete_state(db, main_guild, {"bump_deadline"}) || !db::delete_state(db, 0, {"commands:global:ping"})) {
+        std::cerr << "Failed to delete state" << std::endl;
+        return 1;
+    }
+
+    // Keys with characters that SQL or LIKE would treat specially must come back exactly as they were set
+    const std::map<std::string, int64_t> set = {
+        {"bump_deadline", 1735689600},
+        {"commands:guild:add-text-command", -42},
+        {"100% done", 1},
+        {"back\\slash", 2},
+        {"it's quoted", 3}
+    };
+    if (!db::set_state(db, main_guild, set) || !db::get_state(db, main_guild, got)) {
+        std::cerr << "Failed to set or get state" << std::endl;
+        return 1;
+    }
+    for (const auto& [key, value] : set) {
+        if (auto it = got.find(key); it == got.end() || it->second != value) {
+            std::cerr << "Key " << key << " didn't round trip" << std::endl;
+            failures++;
+        }
+    }
+    if (got.size() != set.size()) {
+        std::cerr << "Got " << got.size() << " keys, expected " << set.size() << std::endl;
+        failures++;
+    }
+
+    // Another server's keys are kept apart, even with the same names
+    got.clear();
+    if (!db::set_state(db, partner_guild, {{"bump_deadline", 5}}) || !db::get_state(db, partner_guild, got)) {
+        std::cerr << "Failed to set or get state" << std::endl;
+        return 1;
+    }
+    if (got != std::map<std::string, int64_t>{{"bump_deadline", 5}}) {
+        std::cerr << "Servers' keys are mixed up" << std::endl;
+        failures++;
+    }
+
+    // Deleted keys must actually match the stored ones, and only in the server they're deleted from
+    got.clear();
+    if (!db::delete_state(db, main_guild, {"bump_deadline", "100% done"}) || !db::get_state(db, main_guild, got)) {
+        std::cerr << "Failed to delete or get state" << std::endl;
+        return 1;
+    }
+    if (got.contains("bump_deadline") || got.contains("100% done") || got.size() != set.size() - 2) {
+        std::cerr << "Deleted keys are still there" << std::endl;
+        failures++;
+    }
+    got.clear();
+    if (!db::get_state(db, partner_guild, got) || !got.contains("bump_deadline")) {
+        std::cerr << "Deleting a key removed it from another server" << std::endl;
+        failures++;
+    }
+
+    sqlite3_close(db);
+    return failures == 0 ? 0 : 1;
+}